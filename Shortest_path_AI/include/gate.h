@@ -8,7 +8,10 @@
 
 #ifndef BSQ_H
 #define BSQ_H
+	#include <stdint.h>
 	#define MAX_PIECES 9
+	#define MAX_COLUMNS (26+2)
+	#define MAX_ROWS (9+2)
 	typedef struct gate {
 		char *buffer; // Buffer for reading in the puzzle
 		char **map; //A line by line map of chars representing the game state
@@ -24,6 +27,8 @@
 								 // lowest y (tie-breaking with lowest x)
 		int piece_y[MAX_PIECES]; // y locations of part of each piece with 
 								 // lowest y (tie-breaking with lowest x)
+		uint64_t hash; // Zobrist hash of the piece positions, kept up to date by the solver
+		int goals_uncovered; // Goal cells not under piece 0, kept up to date by the move code
 	} gate_t;
 	int helper(void);
 	char *read_map(int reading);
@@ -39,7 +44,10 @@
 	gate_t key_check(gate_t gate, char pieceNumber, char direction);
 	gate_t attempt_move(gate_t gate, char pieceNumber, char direction);
 	gate_t move_location(gate_t gate, char piece, char direction);
-	int part_can_move(gate_t gate, int y, int x, char direction);
+	int part_can_move(gate_t const *gate, int y, int x, char direction);
+	void build_passability(gate_t const *gate);
+	int dirty_cells(int const **ys, int const **xs);
+	void clear_dirty_cells(void);
 	void win_check(gate_t gate);
 	void map_check(gate_t gate);
 	int count_case_number(int y, int x, gate_t gate);
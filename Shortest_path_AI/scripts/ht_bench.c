@@ -0,0 +1,254 @@
+/*
+** Benchmarks for the chained table of src/ai/hashtable.c.
+**
+** ht_bench latency [KEYS]
+**	Inserts KEYS (default 4,000,000) random 16-byte keys into a table
+**	set up with 64 chains, and prints the total time and the slowest
+**	single insert. It runs three times: with every resize migrated at
+**	once, as the table did before the incremental rehash, with the
+**	incremental rehash, and with the table reserved up front. Each run
+**	gets its own process, so none pays for the frees of the one before.
+**
+** ht_bench replay FILE
+**	Replays open-set keys captured with `gate -s ... --capture-keys FILE`.
+**	The first pass looks every key up and inserts it if missing, as the
+**	open set does at generation; the second looks every key up again.
+**	Both run with the default hash and compare, and with djb2 and memcmp
+**	through the table's function pointers, as the table hashed before.
+**	Times are per key, the fastest of REPLAY_REPEATS runs.
+**
+** Built with `make bench`.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "hashtable.h"
+
+#define LATENCY_KEYS 4000000
+#define LATENCY_CAPACITY 64
+#define LATENCY_KEY_BYTES 16
+
+#define REPLAY_REPEATS 5
+
+enum latency_mode { STOP_THE_WORLD, INCREMENTAL, RESERVED };
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t next_random(uint64_t *state)
+{
+	uint64_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	*state = x;
+	return x;
+}
+
+static int run_latency(size_t keys, enum latency_mode mode)
+{
+	static const char *names[] = {
+		"stop-the-world rehash", "incremental", "incremental, reserved"
+	};
+	HashTable table;
+	uint64_t key[LATENCY_KEY_BYTES / sizeof(uint64_t)];
+	uint64_t seed = 0x9e3779b97f4a7c15ull;
+	double slowest = 0;
+	double start;
+	double before;
+	double took;
+	int value = 0;
+
+	if (ht_setup(&table, sizeof(key), sizeof(value), LATENCY_CAPACITY) != HT_SUCCESS)
+		return 1;
+	if (mode == RESERVED && ht_reserve(&table, keys) != HT_SUCCESS) {
+		ht_destroy(&table);
+		return 1;
+	}
+	start = now();
+	for (size_t i = 0; i < keys; i++) {
+		key[0] = next_random(&seed);
+		key[1] = next_random(&seed);
+		before = now();
+		if (ht_insert(&table, key, &value) == HT_ERROR) {
+			ht_destroy(&table);
+			return 1;
+		}
+		/* Moving every old chain right away is what _ht_resize() used to do. */
+		if (mode == STOP_THE_WORLD)
+			_ht_migrate(&table, SIZE_MAX);
+		took = now() - before;
+		if (took > slowest)
+			slowest = took;
+	}
+	printf("%-22s %zu keys  total %.2f s  slowest insert %.1f ms\n",
+		names[mode], keys, now() - start, slowest * 1e3);
+	fflush(stdout);
+	ht_destroy(&table);
+	return 0;
+}
+
+static int run_apart(size_t keys, enum latency_mode mode)
+{
+	pid_t pid = fork();
+	int status;
+
+	if (pid < 0)
+		return 1;
+	if (pid == 0)
+		_exit(run_latency(keys, mode));
+	if (waitpid(pid, &status, 0) < 0)
+		return 1;
+	return !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+}
+
+static int latency(int argc, char **argv)
+{
+	size_t keys = argc > 2 ? strtoull(argv[2], NULL, 10) : LATENCY_KEYS;
+
+	if (keys == 0) {
+		fprintf(stderr, "ht_bench: bad key count '%s'\n", argv[2]);
+		return 1;
+	}
+	return run_apart(keys, STOP_THE_WORLD)
+		|| run_apart(keys, INCREMENTAL)
+		|| run_apart(keys, RESERVED);
+}
+
+/* The hash the table used before the wyhash-style default. */
+static size_t djb2_hash(void *raw_key, size_t key_size)
+{
+	const unsigned char *key = raw_key;
+	size_t hash = 5381;
+
+	for (size_t byte = 0; byte < key_size; byte++)
+		hash = ((hash << 5) + hash) ^ key[byte];
+	return hash;
+}
+
+static int memcmp_compare(void *first, void *second, size_t key_size)
+{
+	return memcmp(first, second, key_size);
+}
+
+static int run_replay(const unsigned char *keys, size_t count, int keyBytes,
+	bool old, double *first, double *second)
+{
+	HashTable table;
+	int value = 0;
+	size_t missing = 0;
+	double start;
+	double took;
+
+	*first = *second = 0;
+	for (int repeat = 0; repeat < REPLAY_REPEATS; repeat++) {
+		if (ht_setup(&table, keyBytes, sizeof(value), 0) != HT_SUCCESS)
+			return 1;
+		if (old) {
+			table.hash = djb2_hash;
+			table.compare = memcmp_compare;
+		}
+		start = now();
+		for (size_t i = 0; i < count; i++) {
+			void *key = (void *)(keys + i * keyBytes);
+
+			if (!ht_lookup(&table, key)
+				&& ht_insert(&table, key, &value) == HT_ERROR) {
+				ht_destroy(&table);
+				return 1;
+			}
+		}
+		took = (now() - start) * 1e9 / count;
+		if (*first == 0 || took < *first)
+			*first = took;
+		start = now();
+		for (size_t i = 0; i < count; i++)
+			if (!ht_lookup(&table, (void *)(keys + i * keyBytes)))
+				missing++;
+		took = (now() - start) * 1e9 / count;
+		if (*second == 0 || took < *second)
+			*second = took;
+		ht_destroy(&table);
+	}
+	return missing != 0;
+}
+
+/* Reads a capture: the key size as an int, then the keys back to back. */
+static unsigned char *read_capture(const char *path, size_t *count, int *keyBytes)
+{
+	FILE *file = fopen(path, "rb");
+	unsigned char *keys = NULL;
+	long size;
+
+	if (!file)
+		return NULL;
+	if (fread(keyBytes, sizeof(*keyBytes), 1, file) != 1 || *keyBytes <= 0
+		|| fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) < 0) {
+		fclose(file);
+		return NULL;
+	}
+	*count = (size - sizeof(*keyBytes)) / *keyBytes;
+	if (*count > 0 && (keys = malloc(*count * *keyBytes)) != NULL
+		&& (fseek(file, sizeof(*keyBytes), SEEK_SET) != 0
+			|| fread(keys, *keyBytes, *count, file) != *count)) {
+		free(keys);
+		keys = NULL;
+	}
+	fclose(file);
+	return keys;
+}
+
+static int replay(int argc, char **argv)
+{
+	unsigned char *keys;
+	size_t count = 0;
+	int keyBytes = 0;
+	double first;
+	double second;
+	int status;
+
+	if (argc < 3)
+		return 2;
+	keys = read_capture(argv[2], &count, &keyBytes);
+	if (!keys) {
+		fprintf(stderr, "ht_bench: cannot read keys from %s\n", argv[2]);
+		return 1;
+	}
+	printf("%zu keys of %d bytes\n", count, keyBytes);
+	status = run_replay(keys, count, keyBytes, true, &first, &second);
+	if (status == 0) {
+		printf("djb2, memcmp  first pass %.0f ns  second pass %.0f ns\n", first, second);
+		status = run_replay(keys, count, keyBytes, false, &first, &second);
+	}
+	if (status == 0)
+		printf("default       first pass %.0f ns  second pass %.0f ns\n", first, second);
+	free(keys);
+	return status;
+}
+
+int main(int argc, char **argv)
+{
+	int status = 2;
+
+	if (argc > 1 && strcmp(argv[1], "latency") == 0)
+		status = latency(argc, argv);
+	else if (argc > 1 && strcmp(argv[1], "replay") == 0)
+		status = replay(argc, argv);
+	if (status == 2)
+		fprintf(stderr, "usage: %s latency [KEYS]\n       %s replay FILE\n",
+			argv[0], argv[0]);
+	return status != 0;
+}
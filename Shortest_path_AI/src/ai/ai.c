@@ -6,11 +6,21 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <assert.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <sys/resource.h>
 
 #include "ai.h"
 #include "gate.h"
+#include "board.h"
+#include "cache.h"
+#include "external.h"
+#include "hashtable.h"
 #include "radix.h"
+#include "stateset.h"
+#include "transposition.h"
 #include "utils.h"
+#include "verify.h"
 
 #define DEBUG 0
 
@@ -20,16 +30,156 @@
 #define RIGHT 'r'
 char directions[] = {UP, DOWN, LEFT, RIGHT};
 char invertedDirections[] = {DOWN, UP, RIGHT, LEFT};
+static const int directionDy[4] = {-1, 1, 0, 0};
+static const int directionDx[4] = {0, 0, -1, 1};
 char pieceNames[] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9'};
 
 static int solver_algorithm = 3;
+static bool solver_symmetry = true;
+static bool solver_slide = false;
+static size_t solver_tt_memory = (size_t)64 * 1024 * 1024;
+static const char *solver_scratch_dir = ".";
+static size_t solver_sort_memory = (size_t)64 * 1024 * 1024;
+static const char *solver_save_tree = NULL;
+static const char *solver_load_tree = NULL;
+static const char *solver_cache_dir = NULL;
+static long solver_cache_limit = 64L * 1024 * 1024;
+static const char *solver_checkpoint_path = NULL;
+static double solver_checkpoint_seconds = 300.0;
+static long solver_checkpoint_nodes = 0;
+static const char *solver_resume_path = NULL;
+static long solver_max_nodes = 0;
+static double solver_max_seconds = 0.0;
+static long solver_max_memory = 0;
+static double solver_post_optimize = 0.0;
+/* File the open-set keys looked up by algorithms 1-3 are written to, for scripts/ht_bench. */
+static const char *solver_capture_keys = NULL;
+/* Backend of the closed set and novelty sets of algorithms 1-3. */
+static state_set_kind_t solver_state_set = STATE_SET_AUTO;
+
+/* Search budget consumed by earlier runs of the current find_solution. */
+static double budget_start = 0.0;
+static long budget_expanded = 0;
+/* Set by another thread to abandon the search run by find_hint(). */
+static const atomic_bool *solver_cancel = NULL;
+
+#define LIMIT_NONE 0
+#define LIMIT_NODES 1
+#define LIMIT_SECONDS 2
+#define LIMIT_MEMORY 3
 
 void set_solver_algorithm(int algorithm) {
-	if (algorithm >= 1 && algorithm <= 3) {
+	if (algorithm >= 1 && algorithm <= 5) {
 		solver_algorithm = algorithm;
 	}
 }
 
+void set_solver_symmetry(bool enabled) {
+	solver_symmetry = enabled;
+}
+
+void set_solver_slide(bool enabled) {
+	solver_slide = enabled;
+}
+
+void set_solver_tt_memory(size_t bytes) {
+	if (bytes > 0) {
+		solver_tt_memory = bytes;
+	}
+}
+
+void set_solver_scratch(const char *dir, size_t sortBytes) {
+	if (dir) {
+		solver_scratch_dir = dir;
+	}
+	if (sortBytes > 0) {
+		solver_sort_memory = sortBytes;
+	}
+}
+
+void set_solver_trees(const char *savePath, const char *loadPath) {
+	if (savePath) {
+		solver_save_tree = savePath;
+	}
+	if (loadPath) {
+		solver_load_tree = loadPath;
+	}
+}
+
+void set_solver_cache(const char *dir, long limitBytes) {
+	if (dir) {
+		solver_cache_dir = dir;
+	}
+	if (limitBytes > 0) {
+		solver_cache_limit = limitBytes;
+	}
+}
+
+void set_solver_checkpoint(const char *path, double seconds, long nodes) {
+	if (path) {
+		solver_checkpoint_path = path;
+	}
+	if (seconds > 0) {
+		solver_checkpoint_seconds = seconds;
+	}
+	if (nodes > 0) {
+		solver_checkpoint_nodes = nodes;
+	}
+}
+
+void set_solver_resume(const char *path) {
+	solver_resume_path = path;
+}
+
+void set_solver_limits(long nodes, double seconds, long memoryBytes) {
+	if (nodes > 0) {
+		solver_max_nodes = nodes;
+	}
+	if (seconds > 0) {
+		solver_max_seconds = seconds;
+	}
+	if (memoryBytes > 0) {
+		solver_max_memory = memoryBytes;
+	}
+}
+
+void set_solver_post_optimize(double seconds) {
+	solver_post_optimize = seconds;
+}
+
+void set_solver_capture_keys(const char *path) {
+	solver_capture_keys = path;
+}
+
+bool set_solver_state_set(const char *name) {
+	return state_set_kind_named(name, &solver_state_set);
+}
+
+/*
+	Which limit, if any, the search has reached after expanding the given
+	number of nodes in the current run. Time and memory are only sampled
+	every 1024 expansions.
+*/
+static int search_limit_reached(int expanded) {
+	if (solver_max_nodes > 0 && budget_expanded + expanded >= solver_max_nodes) {
+		return LIMIT_NODES;
+	}
+	if (expanded % 1024 != 0) {
+		return LIMIT_NONE;
+	}
+	if (solver_max_seconds > 0 && now() - budget_start >= solver_max_seconds) {
+		return LIMIT_SECONDS;
+	}
+	if (solver_max_memory > 0) {
+		struct rusage usage;
+		/* Peak resident set size, in kilobytes on Linux. */
+		if (getrusage(RUSAGE_SELF, &usage) == 0 && usage.ru_maxrss * 1024L >= solver_max_memory) {
+			return LIMIT_MEMORY;
+		}
+	}
+	return LIMIT_NONE;
+}
+
 static bool is_valid_direction(char direction) {
 	return direction == UP || direction == DOWN || direction == LEFT || direction == RIGHT;
 }
@@ -53,7 +203,11 @@ static bool find_piece_coordinates(gate_t *state, char pieceChar) {
 	return false;
 }
 
-static bool apply_move_in_place(gate_t *state, char pieceChar, char direction) {
+/*
+	Moves a piece one cell. With a board, the state's hash is updated from the
+	change of anchor; without one it is left as it was.
+*/
+static bool apply_move_in_place(gate_t *state, const board_t *board, char pieceChar, char direction) {
 	if (!state || !is_valid_direction(direction)) {
 		return false;
 	}
@@ -68,12 +222,14 @@ static bool apply_move_in_place(gate_t *state, char pieceChar, char direction) {
 	if (!find_piece_coordinates(state, pieceChar)) {
 		return false;
 	}
+	int fromY = state->piece_y[pieceIdx];
+	int fromX = state->piece_x[pieceIdx];
 
 	bool can_move = true;
 	for (int i = 0; i < state->lines && can_move; i++) {
 		for (int j = 0; state->map[i][j] != '\0'; j++) {
 			char cell = state->map[i][j];
-			if ((cell == pieceChar || cell == letterPiece) && !part_can_move(*state, i, j, direction)) {
+			if ((cell == pieceChar || cell == letterPiece) && !part_can_move(state, i, j, direction)) {
 				can_move = false;
 				break;
 			}
@@ -105,6 +261,9 @@ static bool apply_move_in_place(gate_t *state, char pieceChar, char direction) {
 				}
 
 				char destinationCell = state->map_save[targetY][targetX];
+				if (pieceIdx == 0 && destinationCell == 'G') {
+					state->goals_uncovered--;
+				}
 				if (destinationCell == 'G' || destinationCell == letterPiece) {
 					state->map[targetY][targetX] = letterPiece;
 				} else {
@@ -127,6 +286,9 @@ static bool apply_move_in_place(gate_t *state, char pieceChar, char direction) {
 
 				if (savedCell == letterPiece && !occupiedAfterMove) {
 					state->map[i][j] = 'G';
+					if (pieceIdx == 0) {
+						state->goals_uncovered++;
+					}
 				} else if (savedCell == pieceChar && !occupiedAfterMove) {
 					state->map[i][j] = ' ';
 				}
@@ -135,17 +297,58 @@ static bool apply_move_in_place(gate_t *state, char pieceChar, char direction) {
 	}
 
 	find_piece_coordinates(state, pieceChar);
+	if (board) {
+		state->hash = board_rehash(board, state->hash, pieceIdx, fromY, fromX,
+			state->piece_y[pieceIdx], state->piece_x[pieceIdx]);
+	}
 	return true;
 }
 
-// Node structure for priority queue
+/* Marks every cell with the piece on it plus one, or zero when it is free. */
+static void board_occupancy(const board_t *board, const int *ys, const int *xs,
+	unsigned char occupancy[MAX_ROWS][MAX_COLUMNS]) {
+	memset(occupancy, 0, sizeof(unsigned char) * MAX_ROWS * MAX_COLUMNS);
+	for (int p = 0; p < board->numPieces; p++) {
+		const piece_shape_t *shape = &board->shapes[p];
+		for (int k = 0; k < shape->cellCount; k++) {
+			occupancy[ys[p] + shape->dy[k]][xs[p] + shape->dx[k]] = p + 1;
+		}
+	}
+}
+
+/* Whether a piece anchored at (y, x) stays on the board, off the walls and off every other piece. */
+static bool piece_fits(const board_t *board, unsigned char occupancy[MAX_ROWS][MAX_COLUMNS], int piece,
+	int y, int x) {
+	const piece_shape_t *shape = &board->shapes[piece];
+	for (int k = 0; k < shape->cellCount; k++) {
+		int cy = y + shape->dy[k];
+		int cx = x + shape->dx[k];
+		if (cy < 0 || cy >= board->height || cx < 0 || cx >= board->width || board->wall[cy][cx]
+			|| (occupancy[cy][cx] != 0 && occupancy[cy][cx] != piece + 1)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+	Node structure for priority queue. A node holds the packed anchors of its
+	state and the move that reached it; the map and the move string are only
+	built for the state that ends the search. Parents are kept alive by their
+	children so that the path can be read back from any node.
+*/
 typedef struct search_node {
-    gate_t* state;
     struct search_node* parent;
     int depth;
+    int layers; // Actions taken, less than depth when sliding
+
     int priority;
+    int references; // Held by its queue entry or expansion, and by each child
+    uint64_t hash;
+    char *prefix; // Moves before the first node of a chain, which has no parent
     char piece;
     char direction;
+    unsigned char packed[]; // Anchors as written by packPositions, not canonical
 } search_node_t;
 
 // Priority queue structure (binary min-heap on node priority)
@@ -162,22 +365,42 @@ typedef struct {
 	int expanded;
 	int generated;
 	int duplicated;
+	int pruned;
+	int layers;
+	int prefiltered; // Closed-set lookups answered by the hash filter alone
+	int memory; // Bytes held by the closed set and novelty trees when the run ended
+	bool interrupted; // Stopped by SIGTERM after writing a checkpoint
+	int limit; // LIMIT_NONE, or the search limit that stopped the run
+	char *partial; // Moves to the expanded state with most goal cells under piece 0
+	int partialGoals;
+	int partialDistance;
 } search_run_result_t;
 
-static bool next_combination(int *indices, int size, int totalPieces);
-static void pack_subset(unsigned char *dest, int destBytes, const unsigned char *src, int atomBits,
-	const int *indices, int count);
-static bool all_combinations_present(struct radixTree *tree, const unsigned char *packedMap, int numPieces,
-	int size, int atomBits, unsigned char *buffer, int bufferBytes);
-static void insert_all_combinations(struct radixTree *tree, const unsigned char *packedMap, int numPieces,
-	int size, int atomBits, unsigned char *buffer, int bufferBytes);
-
 // Forward declarations
 gate_t* duplicate_state(gate_t* gate);
 void free_state(gate_t* stateToFree, gate_t *init_data);
 void free_initial_state(gate_t *init_data);
-static void run_search(gate_t *init_data, int width_limit, int packedBytes, search_run_result_t *result);
-static void free_search_node(search_node_t* node);
+static void run_search(gate_t *init_data, const board_t *board, struct radixTree *knownStates,
+	int width_limit, int packedBytes, search_run_result_t *result);
+static void release_search_node(search_node_t* node);
+
+/**
+ * One bit per hash value modulo the filter size, set for every state added to
+ * the closed set. A clear bit means the state has not been expanded, so the
+ * radix tree need not be walked.
+ */
+#define HASH_FILTER_BITS 24
+#define HASH_FILTER_MASK ((1ULL << HASH_FILTER_BITS) - 1)
+
+static bool hash_filter_test(const unsigned char *filter, uint64_t hash) {
+	uint64_t bit = hash & HASH_FILTER_MASK;
+	return (filter[bit >> 3] >> (bit & 7)) & 1;
+}
+
+static void hash_filter_set(unsigned char *filter, uint64_t hash) {
+	uint64_t bit = hash & HASH_FILTER_MASK;
+	filter[bit >> 3] |= (unsigned char)(1 << (bit & 7));
+}
 
 /**
  * Priority queue functions for Uniform Cost Search
@@ -238,14 +461,25 @@ priority_queue_t* init_priority_queue() {
 }
 
 // Create a new search node
-search_node_t* create_search_node(gate_t* state, search_node_t* parent, int depth, char piece, char direction) {
-    search_node_t* node = (search_node_t*)malloc(sizeof(search_node_t));
-    node->state = state;
+search_node_t* create_search_node(search_node_t* parent, int packedBytes, const unsigned char *packed,
+	uint64_t hash, int depth, char piece, char direction) {
+    search_node_t* node = (search_node_t*)malloc(sizeof(search_node_t) + packedBytes);
+    if (!node) {
+        return NULL;
+    }
     node->parent = parent;
     node->depth = depth;
+    node->layers = depth;
     node->priority = depth; // For UCS, priority equals depth
+    node->references = 1;
+    node->hash = hash;
+    node->prefix = NULL;
     node->piece = piece;
     node->direction = direction;
+    memcpy(node->packed, packed, packedBytes);
+    if (parent) {
+        parent->references++;
+    }
     return node;
 }
 
@@ -305,48 +539,65 @@ void free_priority_queue(priority_queue_t* pq) {
 	}
 	for (int i = 0; i < pq->size; i++) {
 		if (pq->nodes[i]) {
-			free_search_node(pq->nodes[i]);
+			release_search_node(pq->nodes[i]);
 		}
 	}
 	free(pq->nodes);
 	free(pq);
 }
 
-// Free search node
-static void free_search_node(search_node_t* node) {
-    if (node) {
-        if (node->state) {
-            free_state(node->state, NULL);
-        }
+// Drop a reference to a search node, freeing it and any parents no longer referenced
+static void release_search_node(search_node_t* node) {
+    while (node && --node->references == 0) {
+        search_node_t* parent = node->parent;
+        free(node->prefix);
         free(node);
+        node = parent;
     }
 }
 
-// Apply action to create new state
-gate_t* apply_action(gate_t* current_state, char piece, char direction) {
-	gate_t* new_state = duplicate_state(current_state);
-	if (!new_state) {
-		return NULL;
-	}
+// Moves from the start of the search to a node; a slide repeats its move once per cell
+static char *search_node_path(const search_node_t* node) {
+    const search_node_t* first = node;
+    while (first->parent) {
+        first = first->parent;
+    }
+    size_t moves = node->depth - first->depth;
+    size_t prefixLength = first->prefix ? strlen(first->prefix) : 0;
+    char *path = (char *)malloc(prefixLength + 2 * moves + 1);
+    if (!path) {
+        return NULL;
+    }
+    if (prefixLength > 0) {
+        memcpy(path, first->prefix, prefixLength);
+    }
+    path[prefixLength + 2 * moves] = '\0';
+    for (; node->parent; node = node->parent) {
+        for (int step = node->depth - node->parent->depth; step > 0; step--) {
+            moves--;
+            path[prefixLength + 2 * moves] = node->piece;
+            path[prefixLength + 2 * moves + 1] = node->direction;
+        }
+    }
+    return path;
+}
 
-	if (!apply_move_in_place(new_state, piece, direction)) {
-		free_state(new_state, NULL);
+/* Full state for the given anchors, reached by the given moves; takes ownership of neither. */
+static gate_t *materialize_state(gate_t *init_data, const board_t *board, const int *ys, const int *xs,
+	const char *solution) {
+	gate_t *state = duplicate_state(init_data);
+	if (!state) {
 		return NULL;
 	}
-
-	size_t old_len = strlen(new_state->soln);
-	char *extended = realloc(new_state->soln, (old_len + 3) * sizeof(char));
-	if (!extended) {
-		free_state(new_state, NULL);
+	char *soln = strdup(solution ? solution : "");
+	if (!soln) {
+		free_state(state, NULL);
 		return NULL;
 	}
-
-	extended[old_len] = piece;
-	extended[old_len + 1] = direction;
-	extended[old_len + 2] = '\0';
-	new_state->soln = extended;
-
-	return new_state;
+	free(state->soln);
+	state->soln = soln;
+	board_stamp(board, ys, xs, state);
+	return state;
 }
 /**
  * Given a game state, work out the number of bytes required to store the state.
@@ -358,10 +609,31 @@ int getPackedSize(gate_t *gate);
 */
 void packMap(gate_t *gate, unsigned char *packedMap);
 
+/**
+ * Store state of puzzle in map, with interchangeable pieces in canonical order.
+*/
+void packMapCanonical(gate_t *gate, const board_t *board, unsigned char *packedMap);
+
+/**
+ * Pack the given anchor positions of each piece.
+*/
+static void packPositions(gate_t *gate, const int *ys, const int *xs, unsigned char *packedMap);
+
+/**
+ * Read the anchor positions of each piece back out of a packed state.
+*/
+static void unpackPositions(gate_t *gate, const unsigned char *packedMap, int *ys, int *xs);
+
+/**
+ * Pack the given anchor positions with interchangeable pieces in canonical order.
+*/
+static void pack_canonical(gate_t *gate, const board_t *board, const int *ys, const int *xs,
+	unsigned char *packedMap);
+
 /**
  * Check if the given state is in a won state.
  */
-bool winning_state(gate_t gate);
+bool winning_state(const gate_t *gate);
 
 gate_t* duplicate_state(gate_t* gate) {
 	if (!gate) return NULL;
@@ -536,73 +808,259 @@ void free_initial_state(gate_t *init_data) {
 	}
 }
 
-static bool next_combination(int *indices, int size, int totalPieces) {
-	for (int i = size - 1; i >= 0; i--) {
-		if (indices[i] < totalPieces - (size - i)) {
-			indices[i]++;
-			for (int j = i + 1; j < size; j++) {
-				indices[j] = indices[j - 1] + 1;
-			}
-			return true;
-		}
-	}
-	return false;
+/**
+ * Checkpoints of run_search. A snapshot holds everything needed to carry on
+ * exactly where the search stopped: the counters, the open list (each node
+ * as its packed piece positions, costs and move string, in heap order), the
+ * hash filter, the closed set and the novelty trees. It is written
+ * sequentially to a temporary file which then replaces the previous
+ * snapshot, so a crash mid-write never loses the last good one.
+ */
+#define CHECKPOINT_MAGIC "GCKP"
+#define CHECKPOINT_VERSION 2
+#define CHECKPOINT_IO_BUFFER (1 << 20)
+
+typedef struct {
+	char magic[4];
+	int32_t version;
+	int32_t widthLimit;
+	int32_t packedBytes;
+	int32_t numPieces;
+	int32_t slide;
+	int32_t symmetry;
+	int32_t expanded;
+	int32_t generated;
+	int32_t duplicated;
+	int32_t pruned;
+	int32_t prefiltered;
+	int64_t openCount;
+	int64_t boardBytes;
+} checkpoint_header_t;
+
+typedef struct {
+	int32_t depth;
+	int32_t layers;
+	int32_t priority;
+	int32_t solnLength;
+	char piece;
+	char direction;
+} checkpoint_node_t;
+
+static volatile sig_atomic_t checkpoint_requested = 0;
+
+static void request_checkpoint(int signum) {
+	(void)signum;
+	checkpoint_requested = 1;
 }
 
-static void pack_subset(unsigned char *dest, int destBytes, const unsigned char *src, int atomBits,
-	const int *indices, int count) {
-	memset(dest, 0, destBytes);
-	int destBit = 0;
-	for (int k = 0; k < count; k++) {
-		int pieceIndex = indices[k];
-		int srcStart = pieceIndex * atomBits;
-		for (int bit = 0; bit < atomBits; bit++, destBit++) {
-			if (getBit((unsigned char *)src, srcStart + bit)) {
-				bitOn(dest, destBit);
-			}
+static bool write_checkpoint(const char *path, gate_t *init_data, int widthLimit, int packedBytes,
+	priority_queue_t *pq, state_set_t *expandedStates, state_set_t **partialStates, int noveltyLimit,
+	const unsigned char *closedFilter, const search_run_result_t *result) {
+	size_t pathLength = strlen(path) + 5;
+	char *temporary = (char *)malloc(pathLength);
+	char *board = normaliseCacheBoard(init_data->map, init_data->lines);
+	FILE *file = NULL;
+	bool ok = false;
+	if (!temporary) {
+		goto checkpoint_write_done;
+	}
+	snprintf(temporary, pathLength, "%s.tmp", path);
+	file = fopen(temporary, "wb");
+	if (!file) {
+		goto checkpoint_write_done;
+	}
+	setvbuf(file, NULL, _IOFBF, CHECKPOINT_IO_BUFFER);
+
+	checkpoint_header_t header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+	header.version = CHECKPOINT_VERSION;
+	header.widthLimit = widthLimit;
+	header.packedBytes = packedBytes;
+	header.numPieces = init_data->num_pieces;
+	header.slide = solver_slide;
+	header.symmetry = solver_symmetry;
+	header.expanded = result->expanded;
+	header.generated = result->generated;
+	header.duplicated = result->duplicated;
+	header.pruned = result->pruned;
+	header.prefiltered = result->prefiltered;
+	header.openCount = pq->size;
+	header.boardBytes = (int64_t)strlen(board);
+	ok = fwrite(&header, sizeof(header), 1, file) == 1
+		&& fwrite(board, 1, header.boardBytes, file) == (size_t)header.boardBytes;
+
+	for (int i = 0; ok && i < pq->size; i++) {
+		search_node_t *node = pq->nodes[i];
+		/* Nodes hold real positions, not canonical ones, so the move strings stay valid. */
+		char *soln = search_node_path(node);
+		if (!soln) {
+			ok = false;
+			break;
 		}
+		checkpoint_node_t record;
+		memset(&record, 0, sizeof(record));
+		record.depth = node->depth;
+		record.layers = node->layers;
+		record.priority = node->priority;
+		record.solnLength = (int32_t)strlen(soln);
+		record.piece = node->piece;
+		record.direction = node->direction;
+		ok = fwrite(&record, sizeof(record), 1, file) == 1
+			&& fwrite(node->packed, 1, packedBytes, file) == (size_t)packedBytes
+			&& fwrite(soln, 1, record.solnLength, file) == (size_t)record.solnLength;
+		free(soln);
 	}
-}
 
-static bool all_combinations_present(struct radixTree *tree, const unsigned char *packedMap, int numPieces,
-	int size, int atomBits, unsigned char *buffer, int bufferBytes) {
-	if (!tree || !packedMap || size <= 0 || size > numPieces) {
-		return true;
+	ok = ok && fwrite(closedFilter, 1, (HASH_FILTER_MASK >> 3) + 1, file) == (HASH_FILTER_MASK >> 3) + 1
+		&& state_set_write(expandedStates, file);
+	for (int i = 0; ok && i < noveltyLimit; i++) {
+		ok = state_set_write(partialStates[i], file);
 	}
-
-	int indices[MAX_PIECES];
-	for (int i = 0; i < size; i++) {
-		indices[i] = i;
+	if (fclose(file) != 0) {
+		ok = false;
+	}
+	if (ok && rename(temporary, path) != 0) {
+		ok = false;
+	}
+	if (!ok) {
+		unlink(temporary);
 	}
 
-	do {
-		pack_subset(buffer, bufferBytes, packedMap, atomBits, indices, size);
-		if (checkPresent(tree, buffer, size) == NOTPRESENT) {
-			return false;
-		}
-	} while (next_combination(indices, size, numPieces));
+checkpoint_write_done:
+	if (temporary) {
+		free(temporary);
+	}
+	free(board);
+	return ok;
+}
 
-	return true;
+/* Reads the width limit of the run a snapshot was taken from, false if it is unreadable. */
+static bool read_checkpoint_width(const char *path, int *widthLimit) {
+	FILE *file = fopen(path, "rb");
+	if (!file) {
+		return false;
+	}
+	checkpoint_header_t header;
+	bool ok = fread(&header, sizeof(header), 1, file) == 1
+		&& memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) == 0
+		&& header.version == CHECKPOINT_VERSION;
+	fclose(file);
+	if (ok) {
+		*widthLimit = header.widthLimit;
+	}
+	return ok;
 }
 
-static void insert_all_combinations(struct radixTree *tree, const unsigned char *packedMap, int numPieces,
-	int size, int atomBits, unsigned char *buffer, int bufferBytes) {
-	if (!tree || !packedMap || size <= 0 || size > numPieces) {
-		return;
+/*
+	Restores a snapshot into the freshly created structures of run_search,
+	replacing its closed set and novelty trees. Fails if the snapshot is of
+	another puzzle or search configuration or is truncated; the structures
+	may then be partly filled and the search must not go on.
+*/
+static bool read_checkpoint(const char *path, gate_t *init_data, const board_t *board, int widthLimit,
+	int packedBytes, priority_queue_t *pq, state_set_t **expandedStates, state_set_t **partialStates,
+	int noveltyLimit, unsigned char *closedFilter, search_run_result_t *result) {
+	FILE *file = fopen(path, "rb");
+	if (!file) {
+		return false;
+	}
+	setvbuf(file, NULL, _IOFBF, CHECKPOINT_IO_BUFFER);
+	char *board_text = normaliseCacheBoard(init_data->map, init_data->lines);
+	char *stored = NULL;
+	unsigned char *packed = (unsigned char *)calloc(packedBytes, sizeof(unsigned char));
+	bool ok = false;
+	int height = init_data->lines;
+	int width = init_data->num_chars_map / init_data->lines;
+
+	checkpoint_header_t header;
+	if (!packed || fread(&header, sizeof(header), 1, file) != 1
+		|| memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0
+		|| header.version != CHECKPOINT_VERSION || header.widthLimit != widthLimit
+		|| header.packedBytes != packedBytes || header.numPieces != init_data->num_pieces
+		|| header.slide != solver_slide || header.symmetry != solver_symmetry
+		|| header.boardBytes != (int64_t)strlen(board_text)) {
+		goto checkpoint_read_done;
+	}
+	stored = (char *)malloc(header.boardBytes + 1);
+	if (!stored || fread(stored, 1, header.boardBytes, file) != (size_t)header.boardBytes
+		|| memcmp(stored, board_text, header.boardBytes) != 0) {
+		goto checkpoint_read_done;
+	}
+
+	int ys[MAX_PIECES];
+	int xs[MAX_PIECES];
+	for (int64_t i = 0; i < header.openCount; i++) {
+		checkpoint_node_t record;
+		if (fread(&record, sizeof(record), 1, file) != 1 || record.solnLength < 0
+			|| fread(packed, 1, packedBytes, file) != (size_t)packedBytes) {
+			goto checkpoint_read_done;
+		}
+		unpackPositions(init_data, packed, ys, xs);
+		search_node_t *node = create_search_node(NULL, packedBytes, packed, board_hash(board, ys, xs),
+			record.depth, record.piece, record.direction);
+		if (!node) {
+			goto checkpoint_read_done;
+		}
+		node->layers = record.layers;
+		node->priority = record.priority;
+		/* A restored node starts a new chain, carrying the moves that led to it. */
+		node->prefix = (char *)malloc(record.solnLength + 1);
+		if (!node->prefix || fread(node->prefix, 1, record.solnLength, file) != (size_t)record.solnLength) {
+			release_search_node(node);
+			goto checkpoint_read_done;
+		}
+		node->prefix[record.solnLength] = '\0';
+		/* Nodes were written in heap order, so no reordering happens. */
+		if (!pq_enqueue(pq, node)) {
+			release_search_node(node);
+			goto checkpoint_read_done;
+		}
 	}
 
-	int indices[MAX_PIECES];
-	for (int i = 0; i < size; i++) {
-		indices[i] = i;
+	if (fread(closedFilter, 1, (HASH_FILTER_MASK >> 3) + 1, file) != (HASH_FILTER_MASK >> 3) + 1) {
+		goto checkpoint_read_done;
 	}
+	state_set_t *closed = state_set_read(file, init_data->num_pieces, init_data->num_pieces, height, width);
+	if (!closed) {
+		goto checkpoint_read_done;
+	}
+	state_set_free(*expandedStates);
+	*expandedStates = closed;
+	for (int i = 0; i < noveltyLimit; i++) {
+		state_set_t *partial = state_set_read(file, init_data->num_pieces, i + 1, height, width);
+		if (!partial) {
+			goto checkpoint_read_done;
+		}
+		state_set_free(partialStates[i]);
+		partialStates[i] = partial;
+	}
+
+	result->expanded = header.expanded;
+	result->generated = header.generated;
+	result->duplicated = header.duplicated;
+	result->pruned = header.pruned;
+	result->prefiltered = header.prefiltered;
+	ok = true;
 
-	do {
-		pack_subset(buffer, bufferBytes, packedMap, atomBits, indices, size);
-		insertRadixTree(tree, buffer, size);
-	} while (next_combination(indices, size, numPieces));
+checkpoint_read_done:
+	fclose(file);
+	if (packed) {
+		free(packed);
+	}
+	if (stored) {
+		free(stored);
+	}
+	free(board_text);
+	return ok;
 }
 
-static void run_search(gate_t *init_data, int width_limit, int packedBytes, search_run_result_t *result) {
+/*
+	knownStates, if given, holds states to treat as already expanded, such as
+	a closed set saved from an earlier search that found no solution.
+*/
+static void run_search(gate_t *init_data, const board_t *board, struct radixTree *knownStates,
+	int width_limit, int packedBytes, search_run_result_t *result) {
 	if (!result) {
 		return;
 	}
@@ -613,6 +1071,15 @@ static void run_search(gate_t *init_data, int width_limit, int packedBytes, sear
 	result->expanded = 0;
 	result->generated = 0;
 	result->duplicated = 0;
+	result->pruned = 0;
+	result->layers = 0;
+	result->prefiltered = 0;
+	result->memory = 0;
+	result->interrupted = false;
+	result->limit = LIMIT_NONE;
+	result->partial = NULL;
+	result->partialGoals = -1;
+	result->partialDistance = INT_MAX;
 
 	if (!init_data) {
 		return;
@@ -622,27 +1089,65 @@ static void run_search(gate_t *init_data, int width_limit, int packedBytes, sear
 		packedBytes = 1;
 	}
 
-	unsigned char *packedMap = (unsigned char *)calloc(packedBytes, sizeof(unsigned char));
-	unsigned char *candidatePacked = (unsigned char *)calloc(packedBytes, sizeof(unsigned char));
-	if (!packedMap || !candidatePacked) {
+	/* Set once the queue runs dry with no solution and nothing pruned for novelty. */
+	bool exhausted = false;
+	/* Declared ahead of the first goto teardown, which frees whatever was made. */
+	priority_queue_t *pq = NULL;
+	state_set_t *expandedStates = NULL;
+	state_set_t **partialStates = NULL;
+	int noveltyLimit = 0;
+	bool searchError = false;
+	FILE *captureFile = NULL;
+
+	/*
+		Open set: canonical key of every state in the queue, mapped to the
+		lowest depth it is queued at. A successor queued no deeper already is
+		dropped at generation. A shallower one (only possible with --slide) is
+		queued again and the deeper copy is discarded when it is popped.
+	*/
+	HashTable openStates = HT_INITIALIZER;
+	/*
+		Its keys are padded with zeros to 8, 16 or 32 bytes where they fit, the
+		widths the table hashes and compares without a loop. Packing never
+		writes the padding of these two buffers, so it stays zero.
+	*/
+	int openKeyBytes = packedBytes;
+	if (packedBytes <= 32) {
+		openKeyBytes = packedBytes <= 8 ? 8 : packedBytes <= 16 ? 16 : 32;
+	}
+	unsigned char *packedMap = (unsigned char *)calloc(openKeyBytes, sizeof(unsigned char));
+	unsigned char *candidatePacked = (unsigned char *)calloc(openKeyBytes, sizeof(unsigned char));
+	unsigned char *childPacked = (unsigned char *)calloc(packedBytes, sizeof(unsigned char));
+	unsigned char *closedFilter = (unsigned char *)calloc((HASH_FILTER_MASK >> 3) + 1, sizeof(unsigned char));
+	unsigned char occupancy[MAX_ROWS][MAX_COLUMNS];
+	if (!packedMap || !candidatePacked || !childPacked || !closedFilter
+		|| ht_setup(&openStates, openKeyBytes, sizeof(int), PQ_INITIAL_CAPACITY) != HT_SUCCESS) {
 		goto teardown;
 	}
 
-	priority_queue_t *pq = init_priority_queue();
-	struct radixTree *expandedStates = NULL;
-	struct radixTree **partialStates = NULL;
-	int noveltyLimit = 0;
-	bool searchError = false;
-	unsigned char **subsetBuffers = NULL;
-	int *subsetBytes = NULL;
-	int atomBits = 0;
+	/*
+		The capture starts with the key size as an int, followed by every key
+		looked up in the open set, in order. Each search rewrites the file, so
+		after algorithm 3 it holds the last.
+	*/
+	if (solver_capture_keys) {
+		captureFile = fopen(solver_capture_keys, "wb");
+		if (!captureFile || fwrite(&openKeyBytes, sizeof(openKeyBytes), 1, captureFile) != 1) {
+			fprintf(stderr, "Unable to write open-set keys to %s\n", solver_capture_keys);
+			if (captureFile) {
+				fclose(captureFile);
+				captureFile = NULL;
+			}
+		}
+	}
 
+	pq = init_priority_queue();
 	if (!pq) {
 		goto teardown;
 	}
 
-	expandedStates = getNewRadixTree(init_data->num_pieces, init_data->lines,
-		init_data->num_chars_map / init_data->lines);
+	expandedStates = state_set_create(solver_state_set, init_data->num_pieces, init_data->num_pieces,
+		init_data->lines, init_data->num_chars_map / init_data->lines);
 	if (!expandedStates) {
 		goto teardown;
 	}
@@ -655,157 +1160,270 @@ static void run_search(gate_t *init_data, int width_limit, int packedBytes, sear
 		noveltyLimit = 0;
 	}
 
-	int pBits = calcBits(init_data->num_pieces);
-	int hBits = calcBits(init_data->lines);
-	int wBits = calcBits(init_data->num_chars_map / init_data->lines);
-	atomBits = pBits + hBits + wBits;
-
 	if (noveltyLimit > 0) {
-		partialStates = (struct radixTree **)malloc(noveltyLimit * sizeof(struct radixTree *));
+		partialStates = (state_set_t **)malloc(noveltyLimit * sizeof(state_set_t *));
 		if (!partialStates) {
 			goto teardown;
 		}
 		for (int i = 0; i < noveltyLimit; i++) {
 			partialStates[i] = NULL;
-			partialStates[i] = getNewRadixTree(init_data->num_pieces, init_data->lines,
-				init_data->num_chars_map / init_data->lines);
+			partialStates[i] = state_set_create(solver_state_set, init_data->num_pieces, i + 1,
+				init_data->lines, init_data->num_chars_map / init_data->lines);
 		}
+	}
 
-		subsetBuffers = (unsigned char **)malloc(noveltyLimit * sizeof(unsigned char *));
-		subsetBytes = (int *)malloc(noveltyLimit * sizeof(int));
-		if (!subsetBuffers || !subsetBytes) {
+	for (int piece = 0; piece < init_data->num_pieces; piece++) {
+		if (board_position_dead(board, piece, init_data->piece_y[piece], init_data->piece_x[piece])) {
+			/* No goal covering is reachable even on an empty board. */
+			result->pruned++;
 			goto teardown;
 		}
-		for (int i = 0; i < noveltyLimit; i++) {
-			subsetBuffers[i] = NULL;
-			subsetBytes[i] = 0;
+	}
+
+	if (solver_resume_path) {
+		/* Only the first run of a search continues from the snapshot. */
+		const char *resumePath = solver_resume_path;
+		solver_resume_path = NULL;
+		if (!read_checkpoint(resumePath, init_data, board, width_limit, packedBytes, pq, &expandedStates,
+			partialStates, noveltyLimit, closedFilter, result)) {
+			fprintf(stderr, "Unable to resume this search from %s\n", resumePath);
+			searchError = true;
+			goto teardown;
 		}
-		for (int i = 0; i < noveltyLimit; i++) {
-			int subsetBits = atomBits * (i + 1);
-			int bytes = (subsetBits + 7) / 8;
-			if (bytes <= 0) {
-				bytes = 1;
+		ht_reserve(&openStates, pq->size);
+		for (int i = 0; i < pq->size; i++) {
+			int ys[MAX_PIECES];
+			int xs[MAX_PIECES];
+			unpackPositions(init_data, pq->nodes[i]->packed, ys, xs);
+			memset(packedMap, 0, packedBytes);
+			pack_canonical(init_data, board, ys, xs, packedMap);
+			int *queuedDepth = (int *)ht_lookup(&openStates, packedMap);
+			if (!queuedDepth || *queuedDepth > pq->nodes[i]->depth) {
+				ht_insert(&openStates, packedMap, &pq->nodes[i]->depth);
 			}
-			subsetBuffers[i] = (unsigned char *)malloc(sizeof(unsigned char) * bytes);
-			if (!subsetBuffers[i]) {
-				goto teardown;
-			}
-			subsetBytes[i] = bytes;
 		}
+	} else {
+		memset(childPacked, 0, packedBytes);
+		packMap(init_data, childPacked);
+		search_node_t *root = create_search_node(NULL, packedBytes, childPacked, init_data->hash, 0, '\0', '\0');
+		if (!root) {
+			goto teardown;
+		}
+		root->prefix = strdup(init_data->soln ? init_data->soln : "");
+		if (!root->prefix || !pq_enqueue(pq, root)) {
+			release_search_node(root);
+			goto teardown;
+		}
+		result->generated++;
 	}
 
-	gate_t *initial_state = duplicate_state(init_data);
-	if (!initial_state) {
-		goto teardown;
-	}
-
-	search_node_t *root = create_search_node(initial_state, NULL, 0, '\0', '\0');
-	if (!root) {
-		free_state(initial_state, NULL);
-		goto teardown;
-	}
-	if (!pq_enqueue(pq, root)) {
-		free_search_node(root);
-		goto teardown;
-	}
-	result->generated++;
-
+	double lastCheckpointTime = now();
+	int lastCheckpointExpanded = result->expanded;
 	while (!pq_is_empty(pq)) {
+		if (solver_cancel && atomic_load(solver_cancel)) {
+			result->interrupted = true;
+			break;
+		}
+		result->limit = search_limit_reached(result->expanded);
+		if (result->limit != LIMIT_NONE) {
+			if (solver_checkpoint_path && !write_checkpoint(solver_checkpoint_path, init_data, width_limit,
+				packedBytes, pq, expandedStates, partialStates, noveltyLimit, closedFilter, result)) {
+				fprintf(stderr, "Unable to write a checkpoint to %s\n", solver_checkpoint_path);
+			}
+			break;
+		}
+		if (solver_checkpoint_path && (checkpoint_requested
+			|| (solver_checkpoint_nodes > 0 && result->expanded - lastCheckpointExpanded >= solver_checkpoint_nodes)
+			|| (result->expanded % 1024 == 0 && now() - lastCheckpointTime >= solver_checkpoint_seconds))) {
+			if (!write_checkpoint(solver_checkpoint_path, init_data, width_limit, packedBytes, pq, expandedStates,
+				partialStates, noveltyLimit, closedFilter, result)) {
+				fprintf(stderr, "Unable to write a checkpoint to %s\n", solver_checkpoint_path);
+			}
+			lastCheckpointTime = now();
+			lastCheckpointExpanded = result->expanded;
+			if (checkpoint_requested) {
+				result->interrupted = true;
+				break;
+			}
+		}
+
 		search_node_t *current = pq_dequeue(pq);
 		result->expanded++;
-		gate_t *current_state = current->state;
-
-		if (winning_state(*current_state)) {
-			const char *srcSoln = current_state->soln ? current_state->soln : "";
-			size_t solnLen = strlen(srcSoln);
-			result->solution = (char *)malloc((solnLen + 1) * sizeof(char));
-			if (result->solution) {
-				strcpy(result->solution, srcSoln);
-			}
-			result->final_state = current_state;
-			result->solved = true;
-			current->state = NULL;
-			free(current);
+		int ys[MAX_PIECES];
+		int xs[MAX_PIECES];
+		unpackPositions(init_data, current->packed, ys, xs);
+
+		if (board_goals_covered(board, ys[0], xs[0]) == board->goalCount) {
+			result->solution = search_node_path(current);
+			result->final_state = materialize_state(init_data, board, ys, xs, result->solution);
+			result->layers = current->layers;
+			result->solved = result->solution && result->final_state;
+			searchError = !result->solved;
+			release_search_node(current);
 			break;
 		}
 
 		memset(packedMap, 0, packedBytes);
-		packMap(current_state, packedMap);
+		pack_canonical(init_data, board, ys, xs, packedMap);
+
+		int *queuedDepth = (int *)ht_lookup(&openStates, packedMap);
+		if (queuedDepth && *queuedDepth < current->depth) {
+			/* Superseded by a shallower copy queued later. */
+			result->duplicated++;
+			release_search_node(current);
+			continue;
+		}
+		if (queuedDepth) {
+			ht_erase(&openStates, packedMap);
+		}
 
-		if (checkPresent(expandedStates, packedMap, current_state->num_pieces)) {
+		if (!hash_filter_test(closedFilter, current->hash)) {
+			result->prefiltered++;
+		} else if (state_set_contains(expandedStates, packedMap)) {
 			result->duplicated++;
-			free_search_node(current);
+			release_search_node(current);
 			continue;
 		}
 
-		insertRadixTree(expandedStates, packedMap, current_state->num_pieces);
+		state_set_insert(expandedStates, packedMap);
+		hash_filter_set(closedFilter, current->hash);
+
+		/* Best partial: most goal cells under piece 0, then piece 0 closest to covering them all. */
+		int goalsCovered = board_goals_covered(board, ys[0], xs[0]);
+		int goalDistance = board->goalDistance[0][ys[0]][xs[0]];
+		if (goalDistance == BOARD_DEAD) {
+			goalDistance = INT_MAX;
+		}
+		if (goalsCovered > result->partialGoals
+			|| (goalsCovered == result->partialGoals && goalDistance < result->partialDistance)) {
+			char *partial = search_node_path(current);
+			if (partial) {
+				if (result->partial) {
+					free(result->partial);
+				}
+				result->partial = partial;
+				result->partialGoals = goalsCovered;
+				result->partialDistance = goalDistance;
+			}
+		}
 
 		if (noveltyLimit > 0) {
-			int currentLimit = current_state->num_pieces < noveltyLimit ? current_state->num_pieces : noveltyLimit;
+			int currentLimit = init_data->num_pieces < noveltyLimit ? init_data->num_pieces : noveltyLimit;
 			for (int size = 1; size <= currentLimit; size++) {
-				insert_all_combinations(partialStates[size - 1], packedMap, current_state->num_pieces,
-					size, atomBits, subsetBuffers[size - 1], subsetBytes[size - 1]);
+				state_set_insert_subsets(partialStates[size - 1], packedMap);
 			}
 		}
 
-		for (int piece = 0; piece < current_state->num_pieces; piece++) {
+		/*
+			Successors are checked against the occupancy of the other pieces and
+			keyed from the anchors alone; no grid is copied for them.
+		*/
+		board_occupancy(board, ys, xs, occupancy);
+		for (int piece = 0; piece < init_data->num_pieces; piece++) {
 			char piece_char = pieceNames[piece];
-			for (int dir = 0; dir < 4; dir++) {
+			int fromY = ys[piece];
+			int fromX = xs[piece];
+			for (int dir = 0; dir < 4 && !searchError && !result->solved; dir++) {
 				char direction = directions[dir];
-				gate_t *next_state = apply_action(current_state, piece_char, direction);
-				if (!next_state) {
-					continue;
-				}
+				/*
+					One cell per action, or with sliding enabled one action per stopping
+					point along the direction. Each stop costs the number of cells moved.
+				*/
+				for (int steps = 1; ; steps++) {
+					int toY = fromY + directionDy[dir] * steps;
+					int toX = fromX + directionDx[dir] * steps;
+					if (!piece_fits(board, occupancy, piece, toY, toX)) {
+						break;
+					}
+					if (board_position_dead(board, piece, toY, toX)) {
+						/* Moves are reversible, so every further stop is dead too. */
+						result->pruned++;
+						break;
+					}
+					uint64_t hash = board_rehash(board, current->hash, piece, fromY, fromX, toY, toX);
+					ys[piece] = toY;
+					xs[piece] = toX;
 
-				memset(candidatePacked, 0, packedBytes);
-				packMap(next_state, candidatePacked);
-
-				bool skip = false;
-				if (checkPresent(expandedStates, candidatePacked, next_state->num_pieces)) {
-					skip = true;
-				} else if (noveltyLimit > 0) {
-					int candidateLimit = next_state->num_pieces < noveltyLimit ? next_state->num_pieces : noveltyLimit;
-					for (int size = 1; size <= candidateLimit; size++) {
-						if (all_combinations_present(partialStates[size - 1], candidatePacked, next_state->num_pieces,
-							size, atomBits, subsetBuffers[size - 1], subsetBytes[size - 1])) {
-							skip = true;
-							break;
+					bool filterHit = hash_filter_test(closedFilter, hash);
+					memset(candidatePacked, 0, packedBytes);
+					pack_canonical(init_data, board, ys, xs, candidatePacked);
+
+					bool skip = false;
+					if (!filterHit) {
+						result->prefiltered++;
+					}
+					if (captureFile) {
+						fwrite(candidatePacked, openKeyBytes, 1, captureFile);
+					}
+					int *queuedDepth = (int *)ht_lookup(&openStates, candidatePacked);
+					if (filterHit && state_set_contains(expandedStates, candidatePacked)) {
+						skip = true;
+					} else if (queuedDepth && *queuedDepth <= current->depth + steps) {
+						skip = true;
+					} else if (knownStates && checkPresent(knownStates, candidatePacked, init_data->num_pieces)) {
+						skip = true;
+					} else if (noveltyLimit > 0) {
+						int candidateLimit = init_data->num_pieces < noveltyLimit ? init_data->num_pieces : noveltyLimit;
+						for (int size = 1; size <= candidateLimit; size++) {
+							if (state_set_contains_subsets(partialStates[size - 1], candidatePacked)) {
+								skip = true;
+								break;
+							}
 						}
 					}
-				}
 
-				if (skip) {
-					result->duplicated++;
-					free_state(next_state, NULL);
-					continue;
-				}
+					if (skip) {
+						result->duplicated++;
+					} else {
+						memset(childPacked, 0, packedBytes);
+						packPositions(init_data, ys, xs, childPacked);
+						search_node_t *child = create_search_node(current, packedBytes, childPacked, hash,
+							current->depth + steps, piece_char, direction);
+						if (!child) {
+							searchError = true;
+						} else {
+							child->layers = current->layers + 1;
+							result->generated++;
+							/*
+								With one cell per action every action costs 1, so no goal found
+								later can be closer than this one: stop at generation.
+							*/
+							if (!solver_slide && piece == 0 && board_goals_covered(board, toY, toX) == board->goalCount) {
+								result->solution = search_node_path(child);
+								result->final_state = materialize_state(init_data, board, ys, xs, result->solution);
+								result->layers = child->layers;
+								result->solved = result->solution && result->final_state;
+								searchError = !result->solved;
+								release_search_node(child);
+							} else if (!pq_enqueue(pq, child)) {
+								release_search_node(child);
+								searchError = true;
+							} else if (ht_insert(&openStates, candidatePacked, &child->depth) == HT_ERROR) {
+								searchError = true;
+							}
+						}
+					}
+					ys[piece] = fromY;
+					xs[piece] = fromX;
 
-				search_node_t *child = create_search_node(next_state, NULL, current->depth + 1, piece_char, direction);
-				if (!child) {
-					free_state(next_state, NULL);
-					searchError = true;
-					break;
-				}
-				if (!pq_enqueue(pq, child)) {
-					free_search_node(child);
-					searchError = true;
-					break;
+					if (!solver_slide || searchError || result->solved) {
+						break;
+					}
 				}
-				result->generated++;
 			}
-			if (searchError) {
+			if (searchError || result->solved) {
 				break;
 			}
 		}
 
-		if (searchError) {
-			free_search_node(current);
+		release_search_node(current);
+		if (searchError || result->solved) {
 			break;
 		}
-
-		free_search_node(current);
 	}
 
+	exhausted = pq_is_empty(pq) && !searchError && !result->solved && noveltyLimit == 0;
+
 	if (searchError) {
 		if (result->solution) {
 			free(result->solution);
@@ -821,37 +1439,40 @@ static void run_search(gate_t *init_data, int width_limit, int packedBytes, sear
 teardown:
 	if (pq) {
 		while (!pq_is_empty(pq)) {
-			search_node_t *node = pq_dequeue(pq);
-			free_search_node(node);
+			release_search_node(pq_dequeue(pq));
 		}
 		free(pq->nodes);
 		free(pq);
 	}
 
-	if (subsetBuffers) {
-		for (int i = 0; i < noveltyLimit; i++) {
-			if (subsetBuffers[i]) {
-				free(subsetBuffers[i]);
-			}
-		}
-		free(subsetBuffers);
-	}
-
-	if (subsetBytes) {
-		free(subsetBytes);
-	}
-
 	if (partialStates) {
 		for (int i = 0; i < noveltyLimit; i++) {
 			if (partialStates[i]) {
-				freeRadixTree(partialStates[i]);
+				result->memory += state_set_memory(partialStates[i]);
+				state_set_free(partialStates[i]);
 			}
 		}
 		free(partialStates);
 	}
 
 	if (expandedStates) {
-		freeRadixTree(expandedStates);
+		/*
+			Only a closed set that rules out every reachable state is saved:
+			--load-tree treats its states as dead. Width-limited runs never
+			qualify and are passed over quietly.
+		*/
+		if (solver_save_tree && exhausted) {
+			char *board_text = normaliseCacheBoard(init_data->map, init_data->lines);
+			if (!state_set_save_tree(expandedStates, solver_save_tree, hashCacheBoard(board_text), solver_symmetry)) {
+				fprintf(stderr, "Unable to write the closed set to %s\n", solver_save_tree);
+			}
+			free(board_text);
+		} else if (solver_save_tree && noveltyLimit == 0) {
+			fprintf(stderr, "Not saving the closed set to %s: the search found a solution or stopped early\n",
+				solver_save_tree);
+		}
+		result->memory += state_set_memory(expandedStates);
+		state_set_free(expandedStates);
 	}
 
 	if (packedMap) {
@@ -860,6 +1481,18 @@ teardown:
 	if (candidatePacked) {
 		free(candidatePacked);
 	}
+	if (childPacked) {
+		free(childPacked);
+	}
+	if (ht_is_initialized(&openStates)) {
+		ht_destroy(&openStates);
+	}
+	if (closedFilter) {
+		free(closedFilter);
+	}
+	if (captureFile && fclose(captureFile) != 0) {
+		fprintf(stderr, "Unable to write open-set keys to %s\n", solver_capture_keys);
+	}
 
 	if (!result->solved) {
 		if (result->solution) {
@@ -873,12 +1506,725 @@ teardown:
 	}
 }
 
+/**
+ * Iterative-deepening A* for algorithm 4. Memory is bounded by the search
+ * depth plus a fixed-size transposition table, which is consulted to skip
+ * states already reached at no greater depth in the same iteration and to
+ * raise the heuristic with bounds learnt in earlier iterations. The state is
+ * held as piece anchors and an occupancy grid, updated in place as moves are
+ * made and undone; only the solution is turned back into a map.
+ */
+#define IDA_FOUND (-1)
+#define IDA_INFINITY INT_MAX
+#define IDA_MAX_KEY_BYTES 32
+
+typedef struct {
+	int iterations;
+	long probes;
+	long hits;
+	long replacements;
+	size_t capacity;
+	size_t memory;
+} ida_stats_t;
+
+typedef struct {
+	gate_t *init_data;
+	const board_t *board;
+	int ys[MAX_PIECES];
+	int xs[MAX_PIECES];
+	unsigned char occupancy[MAX_ROWS][MAX_COLUMNS];
+	uint64_t hash;
+	struct transpositionTable *table;
+	int packedBytes;
+	int iteration;
+	char *path;
+	int solutionLength;
+	search_run_result_t *result;
+} ida_context_t;
+
+typedef struct {
+	int piece;
+	int dir;
+	int h;
+} ida_move_t;
+
+static const int invertedDirIdx[] = {1, 0, 3, 2};
+
+/* Moves a piece's anchor, its cells in the occupancy grid and the hash. */
+static void ida_move_piece(ida_context_t *ctx, int piece, int toY, int toX) {
+	const piece_shape_t *shape = &ctx->board->shapes[piece];
+	int fromY = ctx->ys[piece];
+	int fromX = ctx->xs[piece];
+	for (int k = 0; k < shape->cellCount; k++) {
+		ctx->occupancy[fromY + shape->dy[k]][fromX + shape->dx[k]] = 0;
+	}
+	for (int k = 0; k < shape->cellCount; k++) {
+		ctx->occupancy[toY + shape->dy[k]][toX + shape->dx[k]] = piece + 1;
+	}
+	ctx->hash = board_rehash(ctx->board, ctx->hash, piece, fromY, fromX, toY, toX);
+	ctx->ys[piece] = toY;
+	ctx->xs[piece] = toX;
+}
+
+/*
+	parentH is the heuristic the parent was searched with, or -1 at the root.
+	A state whose move back to its parent is skipped can still learn a bound:
+	that successor costs at least 1 + parentH more.
+*/
+static int ida_search(ida_context_t *ctx, int g, int staticH, int threshold, int lastPiece, int lastDir,
+	int parentH, bool *complete) {
+	int h = staticH;
+	if (g + h > threshold) {
+		return g + h;
+	}
+	const board_t *board = ctx->board;
+	if (h == 0 && board_goals_covered(board, ctx->ys[0], ctx->xs[0]) == board->goalCount) {
+		ctx->solutionLength = g;
+		return IDA_FOUND;
+	}
+
+	unsigned char key[IDA_MAX_KEY_BYTES];
+	memset(key, 0, ctx->packedBytes);
+	pack_canonical(ctx->init_data, board, ctx->ys, ctx->xs, key);
+	uint64_t hash = ctx->hash;
+	int storedDepth, storedIteration, storedBound;
+	if (lookupTransposition(ctx->table, hash, key, &storedDepth, &storedIteration, &storedBound) == TT_FOUND) {
+		if (storedIteration == ctx->iteration && storedDepth <= g) {
+			/* Already searched this iteration with at least as much budget left. */
+			ctx->result->duplicated++;
+			*complete = false;
+			return IDA_INFINITY;
+		}
+		if (storedBound > h) {
+			h = storedBound;
+			if (g + h > threshold) {
+				return g + h;
+			}
+		}
+	}
+	storeTransposition(ctx->table, hash, key, g, ctx->iteration, h);
+	ctx->result->expanded++;
+
+	/* Move ordering: children with the smallest heuristic first. */
+	ida_move_t moves[MAX_PIECES * 4];
+	int moveCount = 0;
+	bool skippedInverse = false;
+	for (int piece = 0; piece < board->numPieces; piece++) {
+		int y = ctx->ys[piece];
+		int x = ctx->xs[piece];
+		for (int dir = 0; dir < 4; dir++) {
+			if (piece == lastPiece && dir == invertedDirIdx[lastDir]) {
+				/* Undoing the previous move leads straight back to the parent. */
+				skippedInverse = true;
+				continue;
+			}
+			int ny = y + directionDy[dir];
+			int nx = x + directionDx[dir];
+			if (!piece_fits(board, ctx->occupancy, piece, ny, nx) || board_position_dead(board, piece, ny, nx)) {
+				continue;
+			}
+			int childH = staticH - board->goalDistance[piece][y][x] + board->goalDistance[piece][ny][nx];
+			int slot = moveCount++;
+			while (slot > 0 && moves[slot - 1].h > childH) {
+				moves[slot] = moves[slot - 1];
+				slot--;
+			}
+			moves[slot].piece = piece;
+			moves[slot].dir = dir;
+			moves[slot].h = childH;
+		}
+	}
+
+	int minExceeded = IDA_INFINITY;
+	bool childrenComplete = true;
+	for (int m = 0; m < moveCount; m++) {
+		int piece = moves[m].piece;
+		int dir = moves[m].dir;
+		int fromY = ctx->ys[piece];
+		int fromX = ctx->xs[piece];
+		ida_move_piece(ctx, piece, fromY + directionDy[dir], fromX + directionDx[dir]);
+		ctx->result->generated++;
+		ctx->path[2 * g] = pieceNames[piece];
+		ctx->path[2 * g + 1] = directions[dir];
+		int t = ida_search(ctx, g + 1, moves[m].h, threshold, piece, dir, h, &childrenComplete);
+		if (t == IDA_FOUND) {
+			return IDA_FOUND;
+		}
+		ida_move_piece(ctx, piece, fromY, fromX);
+		if (t < minExceeded) {
+			minExceeded = t;
+		}
+	}
+
+	if (!childrenComplete) {
+		*complete = false;
+	} else if (minExceeded != IDA_INFINITY || skippedInverse) {
+		/* Every continuation costs at least this much more. */
+		int bound = minExceeded == IDA_INFINITY ? IDA_INFINITY : minExceeded - g;
+		if (skippedInverse && 1 + parentH < bound) {
+			bound = 1 + parentH;
+		}
+		if (bound != IDA_INFINITY && bound > h) {
+			storeTransposition(ctx->table, hash, key, g, ctx->iteration, bound);
+		}
+	}
+	return minExceeded;
+}
+
+static void run_ida_search(gate_t *init_data, const board_t *board, int packedBytes,
+	search_run_result_t *result, ida_stats_t *stats) {
+	memset(result, 0, sizeof(search_run_result_t));
+	memset(stats, 0, sizeof(ida_stats_t));
+	assert(packedBytes <= IDA_MAX_KEY_BYTES);
+
+	int h0 = 0;
+	for (int piece = 0; piece < init_data->num_pieces; piece++) {
+		int y = init_data->piece_y[piece];
+		int x = init_data->piece_x[piece];
+		if (board_position_dead(board, piece, y, x)) {
+			result->pruned++;
+			return;
+		}
+		h0 += board->goalDistance[piece][y][x];
+	}
+
+	ida_context_t ctx;
+	ctx.init_data = init_data;
+	ctx.board = board;
+	for (int piece = 0; piece < init_data->num_pieces; piece++) {
+		ctx.ys[piece] = init_data->piece_y[piece];
+		ctx.xs[piece] = init_data->piece_x[piece];
+	}
+	board_occupancy(board, ctx.ys, ctx.xs, ctx.occupancy);
+	ctx.hash = init_data->hash;
+	ctx.packedBytes = packedBytes;
+	ctx.iteration = 0;
+	ctx.path = NULL;
+	ctx.solutionLength = 0;
+	ctx.result = result;
+	ctx.table = getNewTranspositionTable(solver_tt_memory, packedBytes);
+
+	int threshold = h0;
+	while (true) {
+		ctx.iteration++;
+		char *path = (char *)realloc(ctx.path, (2 * (threshold + 1) + 1) * sizeof(char));
+		if (!path) {
+			break;
+		}
+		ctx.path = path;
+		bool complete = true;
+		int t = ida_search(&ctx, 0, h0, threshold, -1, 0, -1, &complete);
+		if (t == IDA_FOUND) {
+			ctx.path[2 * ctx.solutionLength] = '\0';
+			result->solution = strdup(ctx.path);
+			result->final_state = materialize_state(init_data, board, ctx.ys, ctx.xs, ctx.path);
+			result->layers = ctx.solutionLength;
+			result->solved = result->solution && result->final_state;
+			if (!result->solved) {
+				free(result->solution);
+				result->solution = NULL;
+				if (result->final_state) {
+					free_state(result->final_state, NULL);
+					result->final_state = NULL;
+				}
+			}
+			break;
+		}
+		if (t == IDA_INFINITY) {
+			/* Nothing left beyond the threshold: the reachable space is exhausted. */
+			break;
+		}
+		threshold = t;
+	}
+
+	stats->iterations = ctx.iteration;
+	queryTranspositionStats(ctx.table, &stats->probes, &stats->hits, &stats->replacements);
+	stats->capacity = queryTranspositionCapacity(ctx.table);
+	stats->memory = queryTranspositionMemoryUsage(ctx.table);
+
+	freeTranspositionTable(ctx.table);
+	if (ctx.path) {
+		free(ctx.path);
+	}
+}
+
+/**
+ * External-memory breadth-first search for algorithm 5. Only the layer being
+ * expanded is streamed through memory; candidates for the next layer are
+ * deduplicated on disk (see external.c), so the state space may exceed RAM.
+ */
+typedef struct {
+	int layers;
+	long bytesWritten;
+	size_t memory;
+} external_stats_t;
+
+/* Rebuilds the move string along the stored parent chain ending in goalKey. */
+static char *reconstruct_external(struct externalLayers *layers, gate_t *init_data, const board_t *board,
+	int packedBytes, int goalLayer, uint32_t parentIndex, const unsigned char *goalKey) {
+	int steps = goalLayer + 1;
+	unsigned char *chain = (unsigned char *)calloc((size_t)(steps + 1) * packedBytes, sizeof(unsigned char));
+	char *solution = (char *)malloc((2 * steps + 1) * sizeof(char));
+	gate_t *state = duplicate_state(init_data);
+	if (!chain || !solution || !state) {
+		goto reconstruct_fail;
+	}
+
+	memcpy(chain + (size_t)steps * packedBytes, goalKey, packedBytes);
+	uint32_t index = parentIndex;
+	for (int layer = goalLayer; layer >= 0; layer--) {
+		uint32_t next = 0;
+		if (!readExternalRecord(layers, layer, index, chain + (size_t)layer * packedBytes, &next)) {
+			goto reconstruct_fail;
+		}
+		index = next;
+	}
+
+	/*
+		Stored keys are canonical, so replay from the real start and pick, at
+		each step, the move whose result matches the next key on the chain.
+	*/
+	unsigned char *candidate = (unsigned char *)calloc(packedBytes, sizeof(unsigned char));
+	if (!candidate) {
+		goto reconstruct_fail;
+	}
+	for (int step = 1; step <= steps; step++) {
+		bool matched = false;
+		for (int piece = 0; piece < state->num_pieces && !matched; piece++) {
+			for (int dir = 0; dir < 4 && !matched; dir++) {
+				if (!apply_move_in_place(state, board, pieceNames[piece], directions[dir])) {
+					continue;
+				}
+				memset(candidate, 0, packedBytes);
+				packMapCanonical(state, board, candidate);
+				if (memcmp(candidate, chain + (size_t)step * packedBytes, packedBytes) == 0) {
+					solution[2 * (step - 1)] = pieceNames[piece];
+					solution[2 * (step - 1) + 1] = directions[dir];
+					matched = true;
+				} else {
+					apply_move_in_place(state, board, pieceNames[piece], invertedDirections[dir]);
+				}
+			}
+		}
+		if (!matched) {
+			free(candidate);
+			goto reconstruct_fail;
+		}
+	}
+	solution[2 * steps] = '\0';
+	free(candidate);
+	free(chain);
+	free_state(state, NULL);
+	return solution;
+
+reconstruct_fail:
+	if (chain) {
+		free(chain);
+	}
+	if (solution) {
+		free(solution);
+	}
+	if (state) {
+		free_state(state, NULL);
+	}
+	return NULL;
+}
+
+static void run_external_search(gate_t *init_data, const board_t *board, int packedBytes,
+	search_run_result_t *result, external_stats_t *stats) {
+	memset(result, 0, sizeof(search_run_result_t));
+	memset(stats, 0, sizeof(external_stats_t));
+
+	struct externalLayers *layers = getNewExternalLayers(solver_scratch_dir, packedBytes, solver_sort_memory);
+	if (!layers) {
+		fprintf(stderr, "Unable to create a scratch directory in %s\n", solver_scratch_dir);
+		return;
+	}
+	gate_t *work = duplicate_state(init_data);
+	unsigned char *key = (unsigned char *)calloc(packedBytes, sizeof(unsigned char));
+	unsigned char *child = (unsigned char *)calloc(packedBytes, sizeof(unsigned char));
+	if (!work || !key || !child) {
+		goto external_teardown;
+	}
+
+	for (int piece = 0; piece < init_data->num_pieces; piece++) {
+		if (board_position_dead(board, piece, init_data->piece_y[piece], init_data->piece_x[piece])) {
+			result->pruned++;
+			goto external_teardown;
+		}
+	}
+
+	result->generated++;
+	if (winning_state(work)) {
+		result->solution = (char *)calloc(1, sizeof(char));
+		result->final_state = work;
+		work = NULL;
+		result->solved = result->solution != NULL;
+		goto external_teardown;
+	}
+	packMapCanonical(work, board, key);
+	long duplicated = 0;
+	if (!addExternalCandidate(layers, key, 0) || finishExternalLayer(layers, &duplicated) < 0) {
+		goto external_teardown;
+	}
+
+	int ys[MAX_PIECES];
+	int xs[MAX_PIECES];
+	for (int layer = 0; !result->solved; layer++) {
+		if (!beginExternalLayerRead(layers, layer)) {
+			break;
+		}
+		uint32_t index = 0;
+		bool ioError = false;
+		while (!result->solved && !ioError && readExternalState(layers, key)) {
+			unpackPositions(work, key, ys, xs);
+			board_stamp(board, ys, xs, work);
+			result->expanded++;
+			for (int piece = 0; piece < work->num_pieces && !result->solved && !ioError; piece++) {
+				for (int dir = 0; dir < 4; dir++) {
+					if (!apply_move_in_place(work, board, pieceNames[piece], directions[dir])) {
+						continue;
+					}
+					result->generated++;
+					if (board_position_dead(board, piece, work->piece_y[piece], work->piece_x[piece])) {
+						result->pruned++;
+					} else {
+						memset(child, 0, packedBytes);
+						packMapCanonical(work, board, child);
+						if (winning_state(work)) {
+							result->solution = reconstruct_external(layers, init_data, board, packedBytes,
+								layer, index, child);
+							result->solved = result->solution != NULL;
+							if (result->solved) {
+								result->final_state = duplicate_state(work);
+								result->layers = layer + 1;
+							}
+							break;
+						}
+						if (!addExternalCandidate(layers, child, index)) {
+							ioError = true;
+							break;
+						}
+					}
+					apply_move_in_place(work, board, pieceNames[piece], invertedDirections[dir]);
+				}
+			}
+			index++;
+		}
+		if (result->solved || ioError) {
+			break;
+		}
+		if (finishExternalLayer(layers, &duplicated) <= 0) {
+			/* Empty layer: every reachable state has been expanded. */
+			break;
+		}
+	}
+	result->duplicated = (int)duplicated;
+
+external_teardown:
+	stats->layers = queryExternalLayerCount(layers);
+	stats->bytesWritten = queryExternalBytesWritten(layers);
+	stats->memory = queryExternalMemoryUsage(layers);
+	freeExternalLayers(layers);
+	if (work) {
+		free_state(work, NULL);
+	}
+	if (key) {
+		free(key);
+	}
+	if (child) {
+		free(child);
+	}
+}
+
+/* Keeps whichever of the run's and the best earlier partial covers more goal cells. */
+static void keep_best_partial(search_run_result_t *run, char **partial, int *partialGoals,
+	int *partialDistance) {
+	if (run->partial && (run->partialGoals > *partialGoals
+		|| (run->partialGoals == *partialGoals && run->partialDistance < *partialDistance))) {
+		if (*partial) {
+			free(*partial);
+		}
+		*partial = run->partial;
+		*partialGoals = run->partialGoals;
+		*partialDistance = run->partialDistance;
+	} else if (run->partial) {
+		free(run->partial);
+	}
+	run->partial = NULL;
+}
+
 /**
  * Find a solution by exploring all possible paths
  */
-static void report_results(const char *solnStr, double elapsed, int expanded, int generated,
-	int duplicated, int memoryUsage, gate_t *winning_state_ptr, int num_pieces, int solvingWidth,
-	bool usedFallback, bool has_won, int algorithm);
+static void report_results(const char *solnStr, double elapsed, double searchElapsed, int expanded,
+	int generated, int duplicated, int pruned, int memoryUsage, gate_t *winning_state_ptr, int num_pieces,
+	int interchangeable, int solvingWidth, int layers, bool usedFallback, bool has_won, int algorithm);
+
+/* Nodes a single shortcut search may visit. */
+#define SHORTCUT_NODES (1 << 16)
+
+/* Anchor of every piece; the state representation of the post-optimizer. */
+typedef struct plan_state {
+	unsigned char y[MAX_PIECES];
+	unsigned char x[MAX_PIECES];
+} plan_state_t;
+
+typedef struct shortcut_node {
+	plan_state_t state;
+	int parent;
+	int depth;
+	char piece;
+	char direction;
+} shortcut_node_t;
+
+static int direction_index(char direction) {
+	for (int d = 0; d < 4; d++) {
+		if (directions[d] == direction) {
+			return d;
+		}
+	}
+	return -1;
+}
+
+static void plan_positions(const plan_state_t *state, int numPieces, int *ys, int *xs) {
+	for (int p = 0; p < numPieces; p++) {
+		ys[p] = state->y[p];
+		xs[p] = state->x[p];
+	}
+}
+
+static void pack_plan_state(gate_t *gate, const plan_state_t *state, unsigned char *packedMap) {
+	int ys[MAX_PIECES];
+	int xs[MAX_PIECES];
+	plan_positions(state, gate->num_pieces, ys, xs);
+	packPositions(gate, ys, xs, packedMap);
+}
+
+/* Open-addressed index from plan state to its last position on the plan. */
+static int plan_lookup(const plan_state_t *states, const int *table, int mask, int numPieces,
+	const board_t *board, const plan_state_t *state) {
+	int ys[MAX_PIECES];
+	int xs[MAX_PIECES];
+	plan_positions(state, numPieces, ys, xs);
+	for (int slot = (int)(board_hash(board, ys, xs) & mask); table[slot] >= 0; slot = (slot + 1) & mask) {
+		const plan_state_t *candidate = &states[table[slot]];
+		if (memcmp(candidate->y, state->y, numPieces) == 0 && memcmp(candidate->x, state->x, numPieces) == 0) {
+			return table[slot];
+		}
+	}
+	return -1;
+}
+
+static void plan_index(const plan_state_t *states, int count, int *table, int mask, int numPieces,
+	const board_t *board) {
+	for (int i = 0; i <= mask; i++) {
+		table[i] = -1;
+	}
+	for (int i = 0; i < count; i++) {
+		int ys[MAX_PIECES];
+		int xs[MAX_PIECES];
+		plan_positions(&states[i], numPieces, ys, xs);
+		int slot = (int)(board_hash(board, ys, xs) & mask);
+		/* Later positions of a repeated state replace earlier ones. */
+		while (table[slot] >= 0 && (memcmp(states[table[slot]].y, states[i].y, numPieces) != 0
+			|| memcmp(states[table[slot]].x, states[i].x, numPieces) != 0)) {
+			slot = (slot + 1) & mask;
+		}
+		table[slot] = i;
+	}
+}
+
+/*
+	Shortens a winning plan within the given number of seconds. First every
+	move directly undone by the next is dropped. Then, from each state on the
+	plan, a breadth-first search bounded by SHORTCUT_NODES (with a radix tree
+	as its closed set) looks for a later plan state reachable in fewer moves
+	than the plan takes, and splices in the shortest such detour. The result
+	ends in the same state as the input. If memory runs out, the result is a
+	copy of the input, or NULL if even that cannot be made.
+*/
+static char *post_optimize_solution(gate_t *init_data, const board_t *board, const char *solution,
+	double seconds) {
+	double deadline = now() + seconds;
+	int numPieces = init_data->num_pieces;
+	size_t length = strlen(solution);
+	char *moves = (char *)malloc(length + 1);
+	unsigned char *packedMap = NULL;
+	shortcut_node_t *nodes = NULL;
+	plan_state_t *states = NULL;
+	int *table = NULL;
+	if (!moves) {
+		goto optimize_failed;
+	}
+	int moveCount = 0;
+	for (size_t i = 0; i + 1 < length; i += 2) {
+		char piece = solution[i];
+		char direction = solution[i + 1];
+		int d = direction_index(direction);
+		if (moveCount > 0 && moves[2 * moveCount - 2] == piece && d >= 0
+			&& moves[2 * moveCount - 1] == directions[d ^ 1]) {
+			moveCount--;
+			continue;
+		}
+		moves[2 * moveCount] = piece;
+		moves[2 * moveCount + 1] = direction;
+		moveCount++;
+	}
+	moves[2 * moveCount] = '\0';
+
+	int packedBytes = (getPackedSize(init_data) + 7) / 8;
+	packedMap = (unsigned char *)calloc(packedBytes > 0 ? packedBytes : 1, 1);
+	nodes = (shortcut_node_t *)malloc(SHORTCUT_NODES * sizeof(shortcut_node_t));
+	int mask = 0;
+	unsigned char occupancy[MAX_ROWS][MAX_COLUMNS];
+	if (!packedMap || !nodes) {
+		goto optimize_failed;
+	}
+
+	bool replan = true;
+	int i = 0;
+	while (i < moveCount && now() < deadline) {
+		if (replan) {
+			/* States before and after every move, indexed for lookup. */
+			plan_state_t *grownStates = (plan_state_t *)realloc(states, (moveCount + 1) * sizeof(plan_state_t));
+			if (!grownStates) {
+				goto optimize_failed;
+			}
+			states = grownStates;
+			for (int p = 0; p < numPieces; p++) {
+				states[0].y[p] = init_data->piece_y[p];
+				states[0].x[p] = init_data->piece_x[p];
+			}
+			for (int m = 0; m < moveCount; m++) {
+				int p = moves[2 * m] - '0';
+				int d = direction_index(moves[2 * m + 1]);
+				states[m + 1] = states[m];
+				states[m + 1].y[p] += directionDy[d];
+				states[m + 1].x[p] += directionDx[d];
+			}
+			mask = 1;
+			while (mask < 2 * (moveCount + 1)) {
+				mask <<= 1;
+			}
+			mask--;
+			int *grownTable = (int *)realloc(table, (mask + 1) * sizeof(int));
+			if (!grownTable) {
+				goto optimize_failed;
+			}
+			table = grownTable;
+			plan_index(states, moveCount + 1, table, mask, numPieces, board);
+			replan = false;
+		}
+
+		struct radixTree *visited = getNewRadixTree(numPieces, init_data->lines,
+			init_data->num_chars_map / init_data->lines);
+		if (!visited) {
+			goto optimize_failed;
+		}
+		int head = 0;
+		int tail = 0;
+		int bestNode = -1;
+		int bestTarget = -1;
+		int bestGain = 0;
+		nodes[tail].state = states[i];
+		nodes[tail].parent = -1;
+		nodes[tail].depth = 0;
+		tail++;
+		pack_plan_state(init_data, &states[i], packedMap);
+		insertRadixTree(visited, packedMap, numPieces);
+		/* Only detours shorter than the rest of the plan can gain anything. */
+		while (head < tail && nodes[head].depth + 1 < moveCount - i) {
+			if ((head & 1023) == 0 && now() >= deadline) {
+				break;
+			}
+			shortcut_node_t *node = &nodes[head];
+			int ys[MAX_PIECES];
+			int xs[MAX_PIECES];
+			plan_positions(&node->state, numPieces, ys, xs);
+			board_occupancy(board, ys, xs, occupancy);
+			for (int p = 0; p < numPieces && tail < SHORTCUT_NODES; p++) {
+				for (int d = 0; d < 4 && tail < SHORTCUT_NODES; d++) {
+					if (!piece_fits(board, occupancy, p, ys[p] + directionDy[d], xs[p] + directionDx[d])) {
+						continue;
+					}
+					shortcut_node_t *child = &nodes[tail];
+					child->state = node->state;
+					child->state.y[p] += directionDy[d];
+					child->state.x[p] += directionDx[d];
+					pack_plan_state(init_data, &child->state, packedMap);
+					if (checkPresent(visited, packedMap, numPieces) == PRESENT) {
+						continue;
+					}
+					insertRadixTree(visited, packedMap, numPieces);
+					child->parent = head;
+					child->depth = node->depth + 1;
+					child->piece = '0' + p;
+					child->direction = directions[d];
+					int target = plan_lookup(states, table, mask, numPieces, board, &child->state);
+					if (target > i && target - i - child->depth > bestGain) {
+						bestGain = target - i - child->depth;
+						bestTarget = target;
+						bestNode = tail;
+					}
+					tail++;
+				}
+			}
+			head++;
+		}
+		freeRadixTree(visited);
+
+		if (bestNode < 0) {
+			i++;
+			continue;
+		}
+		/* Replace moves i .. bestTarget - 1 with the detour. */
+		int detour = nodes[bestNode].depth;
+		int newCount = moveCount - (bestTarget - i) + detour;
+		char *shorter = (char *)malloc(2 * newCount + 1);
+		if (!shorter) {
+			goto optimize_failed;
+		}
+		memcpy(shorter, moves, 2 * i);
+		int at = i + detour;
+		for (int n = bestNode; nodes[n].parent >= 0; n = nodes[n].parent) {
+			at--;
+			shorter[2 * at] = nodes[n].piece;
+			shorter[2 * at + 1] = nodes[n].direction;
+		}
+		memcpy(shorter + 2 * (i + detour), moves + 2 * bestTarget, 2 * (moveCount - bestTarget));
+		shorter[2 * newCount] = '\0';
+		free(moves);
+		moves = shorter;
+		moveCount = newCount;
+		replan = true;
+	}
+
+	free(packedMap);
+	free(nodes);
+	free(states);
+	free(table);
+	return moves;
+
+optimize_failed:
+	/* Shortening is optional: fall back to the plan as found. */
+	free(moves);
+	free(packedMap);
+	free(nodes);
+	free(states);
+	free(table);
+	return strdup(solution);
+}
+
+/* The options a solution cache entry is keyed by, for a search with algorithm. */
+static struct cacheSearch cache_search(int algorithm) {
+	struct cacheSearch search;
+	search.algorithm = algorithm;
+	search.slide = solver_slide;
+	search.symmetry = solver_symmetry;
+	search.postOptimize = solver_post_optimize;
+	return search;
+}
 
 void find_solution(gate_t* init_data, int algorithm) {
 	int packedBits = getPackedSize(init_data);
@@ -887,6 +2233,31 @@ void find_solution(gate_t* init_data, int algorithm) {
 		packedBytes = 1;
 	}
 
+	board_t board;
+	board_init(&board, init_data, solver_symmetry);
+	budget_start = now();
+	budget_expanded = 0;
+	init_data->hash = board_hash(&board, init_data->piece_y, init_data->piece_x);
+
+	if (solver_checkpoint_path) {
+		struct sigaction action;
+		memset(&action, 0, sizeof(action));
+		action.sa_handler = request_checkpoint;
+		sigemptyset(&action.sa_mask);
+		sigaction(SIGTERM, &action, NULL);
+	}
+
+	struct radixTree *knownStates = NULL;
+	if (solver_load_tree) {
+		char *board_text = normaliseCacheBoard(init_data->map, init_data->lines);
+		knownStates = loadRadixTree(solver_load_tree, init_data->num_pieces, init_data->lines,
+			init_data->num_chars_map / init_data->lines, hashCacheBoard(board_text), solver_symmetry);
+		free(board_text);
+		if (!knownStates) {
+			fprintf(stderr, "Unable to load a closed set for this puzzle from %s\n", solver_load_tree);
+		}
+	}
+
 	bool has_won = false;
 	double start = now();
 	double elapsed = 0.0;
@@ -895,42 +2266,108 @@ void find_solution(gate_t* init_data, int algorithm) {
 	int totalExpanded = 0;
 	int totalGenerated = 0;
 	int totalDuplicated = 0;
+	int totalPruned = 0;
+	int totalPrefiltered = 0;
 	int solvingWidth = -1;
+	int solutionLayers = 0;
 	bool usedFallback = false;
+	bool interrupted = false;
+	int limit = LIMIT_NONE;
+	char *partial = NULL;
+	int partialGoals = -1;
+	int partialDistance = INT_MAX;
+	int memoryUsage = 0;
+	ida_stats_t idaStats;
+	external_stats_t externalStats;
 
-	if (algorithm == 1) {
+	if (algorithm == 5) {
+		search_run_result_t runResult;
+		run_external_search(init_data, &board, packedBytes, &runResult, &externalStats);
+		totalExpanded = runResult.expanded;
+		totalGenerated = runResult.generated;
+		totalDuplicated = runResult.duplicated;
+		totalPruned = runResult.pruned;
+		has_won = runResult.solved;
+		soln = runResult.solution;
+		winning_state_ptr = runResult.final_state;
+		solutionLayers = runResult.layers;
+		memoryUsage = (int)externalStats.memory;
+		solvingWidth = 0;
+	} else if (algorithm == 4) {
+		search_run_result_t runResult;
+		run_ida_search(init_data, &board, packedBytes, &runResult, &idaStats);
+		totalExpanded = runResult.expanded;
+		totalGenerated = runResult.generated;
+		totalDuplicated = runResult.duplicated;
+		totalPruned = runResult.pruned;
+		has_won = runResult.solved;
+		soln = runResult.solution;
+		winning_state_ptr = runResult.final_state;
+		solutionLayers = runResult.layers;
+		memoryUsage = (int)idaStats.memory;
+		solvingWidth = 0;
+	} else if (algorithm == 1) {
 		int width = init_data->num_pieces + 1;
 		search_run_result_t runResult;
-		run_search(init_data, width, packedBytes, &runResult);
+		run_search(init_data, &board, knownStates, width, packedBytes, &runResult);
 		totalExpanded = runResult.expanded;
 		totalGenerated = runResult.generated;
 		totalDuplicated = runResult.duplicated;
+		totalPruned = runResult.pruned;
+		totalPrefiltered = runResult.prefiltered;
+		memoryUsage = runResult.memory;
+		interrupted = runResult.interrupted;
+		limit = runResult.limit;
+		keep_best_partial(&runResult, &partial, &partialGoals, &partialDistance);
 		has_won = runResult.solved;
 		soln = runResult.solution;
 		winning_state_ptr = runResult.final_state;
+		solutionLayers = runResult.layers;
 		solvingWidth = width;
 	} else if (algorithm == 2) {
 		search_run_result_t runResult;
-		run_search(init_data, 0, packedBytes, &runResult);
+		run_search(init_data, &board, knownStates, 0, packedBytes, &runResult);
 		totalExpanded = runResult.expanded;
 		totalGenerated = runResult.generated;
 		totalDuplicated = runResult.duplicated;
+		totalPruned = runResult.pruned;
+		totalPrefiltered = runResult.prefiltered;
+		memoryUsage = runResult.memory;
+		interrupted = runResult.interrupted;
+		limit = runResult.limit;
+		keep_best_partial(&runResult, &partial, &partialGoals, &partialDistance);
 		has_won = runResult.solved;
 		soln = runResult.solution;
 		winning_state_ptr = runResult.final_state;
+		solutionLayers = runResult.layers;
 		solvingWidth = 0;
 	} else {
 		int maxWidth = init_data->num_pieces > 0 ? init_data->num_pieces : 0;
-		for (int width = 1; width <= maxWidth && !has_won; width++) {
+		int firstWidth = 1;
+		if (solver_resume_path && read_checkpoint_width(solver_resume_path, &firstWidth) && firstWidth == 0) {
+			/* The snapshot was taken in the UCS fallback. */
+			firstWidth = maxWidth + 1;
+		}
+		for (int width = firstWidth; width <= maxWidth && !has_won && !interrupted && limit == LIMIT_NONE; width++) {
 			search_run_result_t runResult;
-			run_search(init_data, width, packedBytes, &runResult);
+			run_search(init_data, &board, knownStates, width, packedBytes, &runResult);
 			totalExpanded += runResult.expanded;
 			totalGenerated += runResult.generated;
 			totalDuplicated += runResult.duplicated;
+			totalPruned += runResult.pruned;
+			totalPrefiltered += runResult.prefiltered;
+			if (runResult.memory > memoryUsage) {
+				memoryUsage = runResult.memory;
+			}
+			interrupted = runResult.interrupted;
+			limit = runResult.limit;
+			budget_expanded += runResult.expanded;
+			keep_best_partial(&runResult, &partial, &partialGoals, &partialDistance);
 			if (runResult.solved) {
 				has_won = true;
 				soln = runResult.solution;
 				winning_state_ptr = runResult.final_state;
+				solutionLayers = runResult.layers;
 				solvingWidth = width;
 			} else {
 				if (runResult.solution) {
@@ -942,17 +2379,26 @@ void find_solution(gate_t* init_data, int algorithm) {
 			}
 		}
 
-		if (!has_won) {
+		if (!has_won && !interrupted && limit == LIMIT_NONE) {
 			search_run_result_t fallbackResult;
-			run_search(init_data, 0, packedBytes, &fallbackResult);
+			run_search(init_data, &board, knownStates, 0, packedBytes, &fallbackResult);
 			totalExpanded += fallbackResult.expanded;
 			totalGenerated += fallbackResult.generated;
 			totalDuplicated += fallbackResult.duplicated;
+			totalPruned += fallbackResult.pruned;
+			totalPrefiltered += fallbackResult.prefiltered;
+			if (fallbackResult.memory > memoryUsage) {
+				memoryUsage = fallbackResult.memory;
+			}
+			interrupted = fallbackResult.interrupted;
+			limit = fallbackResult.limit;
+			keep_best_partial(&fallbackResult, &partial, &partialGoals, &partialDistance);
 			usedFallback = true;
 			if (fallbackResult.solved) {
 				has_won = true;
 				soln = fallbackResult.solution;
 				winning_state_ptr = fallbackResult.final_state;
+				solutionLayers = fallbackResult.layers;
 				solvingWidth = 0;
 			} else {
 				if (fallbackResult.solution) {
@@ -973,10 +2419,79 @@ void find_solution(gate_t* init_data, int algorithm) {
 	}
 
 	elapsed = now() - start;
+
+	int movesBefore = -1;
+	double optimizeTime = 0.0;
+	if (solver_post_optimize > 0 && has_won && soln) {
+		double optimizeStart = now();
+		char *shorter = post_optimize_solution(init_data, &board, soln, solver_post_optimize);
+		optimizeTime = now() - optimizeStart;
+		movesBefore = (int)(strlen(soln) / 2);
+		if (shorter) {
+			free(soln);
+			soln = shorter;
+		}
+		solutionLayers = (int)(strlen(soln) / 2);
+		if (solver_slide) {
+			/* A slide is a run of moves of one piece in one direction. */
+			for (int i = 2; soln[i] != '\0'; i += 2) {
+				if (soln[i] == soln[i - 2] && soln[i + 1] == soln[i - 1]) {
+					solutionLayers--;
+				}
+			}
+		}
+	}
+
 	const char *solnStr = soln ? soln : "";
-	int memoryUsage = 0;
-	report_results(solnStr, elapsed, totalExpanded, totalGenerated, totalDuplicated, memoryUsage,
-		winning_state_ptr, init_data->num_pieces, solvingWidth, usedFallback, has_won, algorithm);
+	report_results(solnStr, elapsed, elapsed, totalExpanded, totalGenerated, totalDuplicated, totalPruned,
+		memoryUsage, winning_state_ptr, init_data->num_pieces, board.interchangeable, solvingWidth, solutionLayers,
+		usedFallback, has_won, algorithm);
+	if (algorithm == 4) {
+		printf("IDA* iterations: %d\n", idaStats.iterations);
+		printf("Transposition table entries: %ld\n", (long)idaStats.capacity);
+		printf("Transposition table probes: %ld\n", idaStats.probes);
+		printf("Transposition table hit rate: %lf\n",
+			idaStats.probes > 0 ? (double)idaStats.hits / idaStats.probes : 0.0);
+		printf("Transposition table replacements: %ld\n", idaStats.replacements);
+	} else if (algorithm == 5) {
+		printf("External BFS layers: %d\n", externalStats.layers);
+		printf("Scratch bytes written: %ld\n", externalStats.bytesWritten);
+	} else {
+		printf("Closed-set lookups skipped by hash: %d\n", totalPrefiltered);
+	}
+	if (movesBefore >= 0) {
+		printf("Post-optimization: %d moves before, %ld after, %lf seconds\n", movesBefore,
+			(long)(strlen(solnStr) / 2), optimizeTime);
+	}
+	if (interrupted) {
+		printf("Search interrupted, resume with --resume %s\n", solver_checkpoint_path);
+	}
+	if (limit != LIMIT_NONE && !has_won) {
+		const char *limitNames[] = {"", "node", "time", "memory"};
+		printf("Search stopped: %s limit reached\n", limitNames[limit]);
+		printf("Best partial goal cells covered: %d of %d\n", partialGoals > 0 ? partialGoals : 0,
+			board.goalCount);
+		if (partialDistance != INT_MAX) {
+			printf("Best partial piece 0 distance to goal: %d\n", partialDistance);
+		}
+		printf("Best partial path: %s\n", partial ? partial : "");
+	}
+	if (solver_cache_dir && has_won) {
+		struct cacheEntry entry;
+		entry.algorithm = algorithm;
+		entry.width = solvingWidth > 0 ? solvingWidth : 0;
+		entry.layers = solutionLayers;
+		entry.expanded = totalExpanded;
+		entry.generated = totalGenerated;
+		entry.duplicated = totalDuplicated;
+		entry.elapsed = elapsed;
+		entry.solution = (char *)solnStr;
+		char *cacheBoard = normaliseCacheBoard(init_data->map, init_data->lines);
+		struct cacheSearch search = cache_search(algorithm);
+		bool stored = storeCachedSolution(solver_cache_dir, cacheBoard, &search, &entry, solver_cache_limit);
+		printf("Solution cache: %s\n", stored ? "stored" : "not stored");
+		free(cacheBoard);
+	}
 
 	if (winning_state_ptr) {
 		free_state(winning_state_ptr, NULL);
@@ -984,10 +2499,40 @@ void find_solution(gate_t* init_data, int algorithm) {
 	if (soln) {
 		free(soln);
 	}
+	if (knownStates) {
+		freeRadixTree(knownStates);
+	}
+	if (partial) {
+		free(partial);
+	}
 
 	free_initial_state(init_data);
 }
 
+char *find_hint(gate_t *position, const atomic_bool *cancel) {
+	int packedBytes = (getPackedSize(position) + 7) / 8;
+	board_t board;
+	board_init(&board, position, solver_symmetry);
+	position->hash = board_hash(&board, position->piece_y, position->piece_x);
+
+	solver_cancel = cancel;
+	search_run_result_t result;
+	run_search(position, &board, NULL, 0, packedBytes, &result);
+	solver_cancel = NULL;
+
+	if (result.final_state) {
+		free_state(result.final_state, NULL);
+	}
+	if (result.partial) {
+		free(result.partial);
+	}
+	if (!result.solved && result.solution) {
+		free(result.solution);
+		result.solution = NULL;
+	}
+	return result.solution;
+}
+
 /**
  * Given a game state, work out the number of bytes required to store the state.
 */
@@ -1000,54 +2545,242 @@ int getPackedSize(gate_t *gate) {
 	return bitCount;
 }
 
+/*
+	Bit layout of packed keys for one board size. Key bits are numbered from
+	the highest bit of the first byte, while each field is written lowest bit
+	first, so fields are kept as bit-reversed codes. The layout is worked out
+	once per board size, and picks a packing kernel for the key width.
+*/
+#define KEY_ROW_CODES 16
+#define KEY_COLUMN_CODES 32
+
+typedef struct key_layout {
+	int numPieces;
+	int height;
+	int width;
+	int pBits;
+	int hBits;
+	int wBits;
+	int atomBits;
+	int keyBytes;
+	uint32_t pieceCode[MAX_PIECES]; // Piece field, shifted above the row and column fields
+	unsigned char rowCode[KEY_ROW_CODES];
+	unsigned char columnCode[KEY_COLUMN_CODES];
+	void (*pack)(const struct key_layout *layout, const int *ys, const int *xs, unsigned char *packedMap);
+	void (*unpack)(const struct key_layout *layout, const unsigned char *packedMap, int *ys, int *xs);
+} key_layout_t;
+
+static unsigned int reverse_bits(unsigned int value, int bits) {
+	unsigned int reversed = 0;
+	for (int j = 0; j < bits; j++) {
+		reversed |= ((value >> j) & 1) << (bits - 1 - j);
+	}
+	return reversed;
+}
+
+/* ORs a field of at most 64 bits into words at bit bitIdx. */
+static inline void key_put(uint64_t *words, int bitIdx, uint64_t value, int bits) {
+	int word = bitIdx / 64;
+	int end = bitIdx % 64 + bits;
+	if (end <= 64) {
+		words[word] |= value << (64 - end);
+	} else {
+		words[word] |= value >> (end - 64);
+		words[word + 1] |= value << (128 - end);
+	}
+}
+
+static inline uint64_t key_get(const uint64_t *words, int bitIdx, int bits) {
+	int word = bitIdx / 64;
+	int end = bitIdx % 64 + bits;
+	uint64_t mask = (((uint64_t)1) << bits) - 1;
+	if (end <= 64) {
+		return (words[word] >> (64 - end)) & mask;
+	}
+	return ((words[word] << (end - 64)) | (words[word + 1] >> (128 - end))) & mask;
+}
+
+/*
+	Packing kernels for keys of at most WORDS 64 bit words: every piece is one
+	table lookup per field and one shift into a register-sized buffer, and the
+	bytes are written out once at the end.
+*/
+#define DEFINE_KEY_KERNELS(WORDS) \
+static void pack_key_##WORDS(const key_layout_t *layout, const int *ys, const int *xs, \
+	unsigned char *packedMap) { \
+	uint64_t words[WORDS] = {0}; \
+	for (int i = 0; i < layout->numPieces; i++) { \
+		uint64_t atom = layout->pieceCode[i] | ((uint64_t)layout->rowCode[ys[i]] << layout->wBits) \
+			| layout->columnCode[xs[i]]; \
+		key_put(words, i * layout->atomBits, atom, layout->atomBits); \
+	} \
+	for (int b = 0; b < layout->keyBytes; b++) { \
+		packedMap[b] = (unsigned char)(words[b / 8] >> (56 - 8 * (b % 8))); \
+	} \
+} \
+static void unpack_key_##WORDS(const key_layout_t *layout, const unsigned char *packedMap, int *ys, \
+	int *xs) { \
+	uint64_t words[WORDS] = {0}; \
+	for (int b = 0; b < layout->keyBytes; b++) { \
+		words[b / 8] |= (uint64_t)packedMap[b] << (56 - 8 * (b % 8)); \
+	} \
+	uint64_t rowMask = (((uint64_t)1) << layout->hBits) - 1; \
+	uint64_t columnMask = (((uint64_t)1) << layout->wBits) - 1; \
+	for (int i = 0; i < layout->numPieces; i++) { \
+		uint64_t atom = key_get(words, i * layout->atomBits, layout->atomBits); \
+		ys[i] = layout->rowCode[(atom >> layout->wBits) & rowMask]; \
+		xs[i] = layout->columnCode[atom & columnMask]; \
+	} \
+}
+
+DEFINE_KEY_KERNELS(1)
+DEFINE_KEY_KERNELS(2)
+
+/*
+	Layout for the board size of gate. It is rebuilt only when the size
+	changes, so the kernel is chosen once per puzzle.
+*/
+static const key_layout_t *key_layout_for(gate_t *gate) {
+	static key_layout_t layout = {0};
+	int width = gate->num_chars_map / gate->lines;
+	if (layout.pack && layout.numPieces == gate->num_pieces && layout.height == gate->lines
+		&& layout.width == width) {
+		return &layout;
+	}
+	layout.numPieces = gate->num_pieces;
+	layout.height = gate->lines;
+	layout.width = width;
+	layout.pBits = calcBits(gate->num_pieces);
+	layout.hBits = calcBits(gate->lines);
+	layout.wBits = calcBits(width);
+	layout.atomBits = layout.pBits + layout.hBits + layout.wBits;
+	int keyBits = layout.atomBits * layout.numPieces;
+	layout.keyBytes = (keyBits + 7) / 8;
+	assert((1 << layout.hBits) <= KEY_ROW_CODES && (1 << layout.wBits) <= KEY_COLUMN_CODES);
+	for (int i = 0; i < layout.numPieces; i++) {
+		layout.pieceCode[i] = reverse_bits(i, layout.pBits) << (layout.hBits + layout.wBits);
+	}
+	for (int y = 0; y < (1 << layout.hBits); y++) {
+		layout.rowCode[y] = reverse_bits(y, layout.hBits);
+	}
+	for (int x = 0; x < (1 << layout.wBits); x++) {
+		layout.columnCode[x] = reverse_bits(x, layout.wBits);
+	}
+	/* MAX_PIECES, MAX_ROWS and MAX_COLUMNS give keys of at most 117 bits. */
+	assert(keyBits <= 128);
+	if (keyBits <= 64) {
+		layout.pack = pack_key_1;
+		layout.unpack = unpack_key_1;
+	} else {
+		layout.pack = pack_key_2;
+		layout.unpack = unpack_key_2;
+	}
+	return &layout;
+}
+
+/**
+ * Pack the given anchor positions of each piece.
+*/
+static void packPositions(gate_t *gate, const int *ys, const int *xs, unsigned char *packedMap) {
+	const key_layout_t *layout = key_layout_for(gate);
+	layout->pack(layout, ys, xs, packedMap);
+}
+
+/**
+ * Read the anchor positions of each piece back out of a packed state.
+*/
+static void unpackPositions(gate_t *gate, const unsigned char *packedMap, int *ys, int *xs) {
+	const key_layout_t *layout = key_layout_for(gate);
+	layout->unpack(layout, packedMap, ys, xs);
+}
+
 /**
  * Store state of puzzle in map.
 */
 void packMap(gate_t *gate, unsigned char *packedMap) {
-	int pBits = calcBits(gate->num_pieces);
-    int hBits = calcBits(gate->lines);
-    int wBits = calcBits(gate->num_chars_map / gate->lines);
-	int bitIdx = 0;
-	for(int i = 0; i < gate->num_pieces; i++) {
-		for(int j = 0; j < pBits; j++) {
-			if(((i >> j) & 1) == 1) {
-				bitOn( packedMap, bitIdx );
-			} else {
-				bitOff( packedMap, bitIdx );
-			}
-			bitIdx++;
-		}
-		for(int j = 0; j < hBits; j++) {
-			if(((gate->piece_y[i] >> j) & 1) == 1) {
-				bitOn( packedMap, bitIdx );
-			} else {
-				bitOff( packedMap, bitIdx );
-			}
-			bitIdx++;
-		}
-		for(int j = 0; j < wBits; j++) {
-			if(((gate->piece_x[i] >> j) & 1) == 1) {
-				bitOn( packedMap, bitIdx );
-			} else {
-				bitOff( packedMap, bitIdx );
-			}
-			bitIdx++;
-		}
+	packPositions(gate, gate->piece_y, gate->piece_x, packedMap);
+}
+
+/**
+ * Pack the given anchor positions with interchangeable pieces in canonical order.
+*/
+static void pack_canonical(gate_t *gate, const board_t *board, const int *ys, const int *xs,
+	unsigned char *packedMap) {
+	if (board->interchangeable == 0) {
+		packPositions(gate, ys, xs, packedMap);
+		return;
 	}
+	int canonicalY[MAX_PIECES];
+	int canonicalX[MAX_PIECES];
+	board_canonical_positions(board, ys, xs, canonicalY, canonicalX);
+	packPositions(gate, canonicalY, canonicalX, packedMap);
 }
 
 /**
- * Check if the given state is in a won state.
+ * Store state of puzzle in map, with interchangeable pieces in canonical order.
+*/
+void packMapCanonical(gate_t *gate, const board_t *board, unsigned char *packedMap) {
+	pack_canonical(gate, board, gate->piece_y, gate->piece_x, packedMap);
+}
+
+/**
+ * Check if the given state is in a won state: piece 0 covers every goal cell.
  */
-bool winning_state(gate_t gate) {
-	for (int i = 0; i < gate.lines; i++) {
-		for (int j = 0; gate.map_save[i][j] != '\0'; j++) {
-			if (gate.map[i][j] == 'G' || (gate.map[i][j] >= 'I' && gate.map[i][j] <= 'Q')) {
-				return false;
-			}
+bool winning_state(const gate_t *gate) {
+	return gate->goals_uncovered == 0;
+}
+
+/**
+ * Replays a move string from the given state, returning the final state if
+ * every move is legal and it is a winning state, or NULL otherwise.
+ */
+static gate_t *replay_solution(gate_t *start, const char *solution) {
+	verify_grid_t grid;
+	if (!verify_init(&grid, start->map, start->lines)
+		|| verify_solution(&grid, solution).status != VERIFY_SOLVED) {
+		return NULL;
+	}
+	gate_t *state = duplicate_state(start);
+	if (!state) {
+		return NULL;
+	}
+	verify_copy_map(&grid, state->map);
+	for (int i = 0; i < state->num_pieces; i++) {
+		find_piece_coordinates(state, '0' + i);
+	}
+	return state;
+}
+
+/**
+ * Reports a cached solution for the puzzle if the cache holds one found
+ * with the same algorithm and options that replays to a win. Entries which
+ * fail to replay are removed.
+ */
+static bool report_cached_solution(gate_t *gate) {
+	double start = now();
+	char *cacheBoard = normaliseCacheBoard(gate->map, gate->lines);
+	struct cacheSearch search = cache_search(solver_algorithm);
+	struct cacheEntry entry;
+	bool reported = false;
+	if (lookupCachedSolution(solver_cache_dir, cacheBoard, &search, &entry)) {
+		gate_t *final_state = replay_solution(gate, entry.solution);
+		if (final_state) {
+			board_t board;
+			board_init(&board, gate, solver_symmetry);
+			/* The counts are those of the cached search, so the rate is too. */
+			report_results(entry.solution, now() - start, entry.elapsed, (int)entry.expanded,
+				(int)entry.generated, (int)entry.duplicated, 0, 0, final_state, gate->num_pieces,
+				board.interchangeable, entry.width, entry.layers, false, true, entry.algorithm);
+			printf("Solution cache: hit, search took %lf\n", entry.elapsed);
+			free_state(final_state, NULL);
+			reported = true;
+		} else {
+			dropCachedSolution(solver_cache_dir, cacheBoard, &search);
 		}
+		freeCacheEntry(&entry);
 	}
-	return true;
+	free(cacheBoard);
+	return reported;
 }
 
 void solve(char const *path)
@@ -1080,22 +2813,30 @@ void solve(char const *path)
 		gate.soln[0] = '\0';
 	}
 
+	if (solver_cache_dir && report_cached_solution(&gate)) {
+		free_initial_state(&gate);
+		return;
+	}
+
 	find_solution(&gate, solver_algorithm);
 
 }
 
-static void report_results(const char *solnStr, double elapsed, int expanded, int generated,
-	int duplicated, int memoryUsage, gate_t *winning_state_ptr, int num_pieces, int solvingWidth,
-	bool usedFallback, bool has_won, int algorithm) {
+static void report_results(const char *solnStr, double elapsed, double searchElapsed, int expanded,
+	int generated, int duplicated, int pruned, int memoryUsage, gate_t *winning_state_ptr, int num_pieces,
+	int interchangeable, int solvingWidth, int layers, bool usedFallback, bool has_won, int algorithm) {
 	printf("Solution path: ");
 	printf("%s\n", solnStr);
 	printf("Execution time: %lf\n", elapsed);
 	printf("Expanded nodes: %d\n", expanded);
 	printf("Generated nodes: %d\n", generated);
 	printf("Duplicated nodes: %d\n", duplicated);
+	printf("Pruned as dead: %d\n", pruned);
 	printf("Auxiliary memory usage (bytes): %d\n", memoryUsage);
 	printf("Number of pieces in the puzzle: %d\n", num_pieces);
+	printf("Interchangeable pieces: %d\n", interchangeable);
 	printf("Number of steps in solution: %ld\n", (long)(strlen(solnStr) / 2));
+	printf("Number of search layers in solution: %d\n", layers);
 	int emptySpaces = 0;
 	if (winning_state_ptr) {
 		for (int i = 0; i < winning_state_ptr->lines; i++) {
@@ -1114,6 +2855,18 @@ static void report_results(const char *solnStr, double elapsed, int expanded, in
 		} else {
 			snprintf(solvedBy, sizeof(solvedBy), "Algorithm1-IW(%d) (no solution)", solvingWidth);
 		}
+	} else if (algorithm == 5) {
+		if (has_won) {
+			snprintf(solvedBy, sizeof(solvedBy), "Algorithm5-ExternalBFS");
+		} else {
+			snprintf(solvedBy, sizeof(solvedBy), "Algorithm5-ExternalBFS (no solution)");
+		}
+	} else if (algorithm == 4) {
+		if (has_won) {
+			snprintf(solvedBy, sizeof(solvedBy), "Algorithm4-IDA*");
+		} else {
+			snprintf(solvedBy, sizeof(solvedBy), "Algorithm4-IDA* (no solution)");
+		}
 	} else if (algorithm == 2) {
 		if (has_won) {
 			snprintf(solvedBy, sizeof(solvedBy), "Algorithm2-UCS");
@@ -1136,5 +2889,5 @@ static void report_results(const char *solnStr, double elapsed, int expanded, in
 		}
 	}
 	printf("Solved by %s\n", solvedBy);
-	printf("Number of nodes expanded per second: %lf\n", (expanded + 1) / (elapsed > 0 ? elapsed : 1));
+	printf("Number of nodes expanded per second: %lf\n", (expanded + 1) / (searchElapsed > 0 ? searchElapsed : 1));
 }
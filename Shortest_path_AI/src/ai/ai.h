@@ -2,9 +2,51 @@
 #define __AI__
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <unistd.h>
+#include <stdatomic.h>
+
+#include "gate.h"
 
 void solve(char const *path);
 void set_solver_algorithm(int algorithm);
+/* Treat pieces of identical shape as interchangeable when detecting duplicates. */
+void set_solver_symmetry(bool enabled);
+/* Let a piece slide any number of cells in one action, costed per cell. */
+void set_solver_slide(bool enabled);
+/* Memory budget of the IDA* transposition table. */
+void set_solver_tt_memory(size_t bytes);
+/* Scratch directory and sort buffer size for the external-memory search. */
+void set_solver_scratch(const char *dir, size_t sortBytes);
+/* Files to save the closed set to, and to map a closed set of known states from. */
+void set_solver_trees(const char *savePath, const char *loadPath);
+/* Directory and size limit of the on-disk solution cache; no cache unless a directory is set. */
+void set_solver_cache(const char *dir, long limitBytes);
+/*
+	Snapshot file for algorithms 1-3, written every seconds of search, every
+	nodes expansions if nodes is set, and on SIGTERM before stopping.
+*/
+void set_solver_checkpoint(const char *path, double seconds, long nodes);
+/* Snapshot to continue the search from. */
+void set_solver_resume(const char *path);
+/* Stop algorithms 1-3 after this many expansions, seconds or bytes of peak memory; 0 for no limit. */
+void set_solver_limits(long nodes, double seconds, long memoryBytes);
+/* Seconds to spend shortening a found plan with shortcut searches; 0 to keep it as found. */
+void set_solver_post_optimize(double seconds);
+/* File to write every open-set key looked up by algorithms 1-3 to; NULL for none. */
+void set_solver_capture_keys(const char *path);
+/* Closed and novelty set backend of algorithms 1-3 by name; false if there is no such backend. */
+bool set_solver_state_set(const char *name);
+
+/* Deep copy of a state, including its map and solution string. */
+gate_t *duplicate_state(gate_t *gate);
+void free_state(gate_t *stateToFree, gate_t *init_data);
+/*
+	Runs UCS from position, which must have its pieces located and a solution
+	string, and returns the optimal move string (freed by the caller). Returns
+	NULL when there is no solution or when cancel becomes true, which another
+	thread may set at any time. Prints nothing. Only one search may run at once.
+*/
+char *find_hint(gate_t *position, const atomic_bool *cancel);
 
 #endif
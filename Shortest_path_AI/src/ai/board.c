@@ -0,0 +1,249 @@
+#include <string.h>
+#include <stdbool.h>
+
+#include "board.h"
+
+static bool cell_is_piece(char cell, int piece) {
+	return cell == '0' + piece || cell == 'H' + piece;
+}
+
+static void read_shape(gate_t *gate, int piece, piece_shape_t *shape) {
+	shape->cellCount = 0;
+	for (int i = 0; i < gate->lines; i++) {
+		for (int j = 0; gate->map[i][j] != '\0'; j++) {
+			if (cell_is_piece(gate->map[i][j], piece)) {
+				shape->dy[shape->cellCount] = i - gate->piece_y[piece];
+				shape->dx[shape->cellCount] = j - gate->piece_x[piece];
+				shape->cellCount++;
+			}
+		}
+	}
+}
+
+static bool same_shape(const piece_shape_t *a, const piece_shape_t *b) {
+	if (a->cellCount != b->cellCount) {
+		return false;
+	}
+	/* Both shapes are read in row-major order, so equal shapes list cells identically. */
+	for (int k = 0; k < a->cellCount; k++) {
+		if (a->dy[k] != b->dy[k] || a->dx[k] != b->dx[k]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* splitmix64, seeded with a constant so hashes are the same on every run. */
+static uint64_t next_key(uint64_t *seed) {
+	uint64_t z = (*seed += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+/* Whether every cell of the piece fits on the board without overlapping a wall. */
+static bool anchor_valid(const board_t *board, int piece, int y, int x) {
+	const piece_shape_t *shape = &board->shapes[piece];
+	for (int k = 0; k < shape->cellCount; k++) {
+		int cy = y + shape->dy[k];
+		int cx = x + shape->dx[k];
+		if (cy < 0 || cy >= board->height || cx < 0 || cx >= board->width || board->wall[cy][cx]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool anchor_is_target(const board_t *board, int piece, int y, int x, int goalCount) {
+	const piece_shape_t *shape = &board->shapes[piece];
+	int covered = 0;
+	for (int k = 0; k < shape->cellCount; k++) {
+		if (board->goal[y + shape->dy[k]][x + shape->dx[k]]) {
+			covered++;
+		}
+	}
+	return piece == 0 ? covered == goalCount : covered == 0;
+}
+
+/*
+	Multi-source breadth-first search outwards from every target anchor. Moves
+	on an empty board are reversible, so the distance to the nearest target is
+	the same in both directions.
+*/
+static void compute_goal_distances(board_t *board, int piece, int goalCount) {
+	static int queueY[BOARD_MAX_CELLS];
+	static int queueX[BOARD_MAX_CELLS];
+	int head = 0;
+	int tail = 0;
+	const int dy[4] = {-1, 1, 0, 0};
+	const int dx[4] = {0, 0, -1, 1};
+
+	for (int y = 0; y < MAX_ROWS; y++) {
+		for (int x = 0; x < MAX_COLUMNS; x++) {
+			board->goalDistance[piece][y][x] = BOARD_DEAD;
+		}
+	}
+	for (int y = 0; y < board->height; y++) {
+		for (int x = 0; x < board->width; x++) {
+			if (anchor_valid(board, piece, y, x) && anchor_is_target(board, piece, y, x, goalCount)) {
+				board->goalDistance[piece][y][x] = 0;
+				queueY[tail] = y;
+				queueX[tail] = x;
+				tail++;
+			}
+		}
+	}
+	while (head < tail) {
+		int y = queueY[head];
+		int x = queueX[head];
+		head++;
+		for (int d = 0; d < 4; d++) {
+			int ny = y + dy[d];
+			int nx = x + dx[d];
+			if (ny < 0 || ny >= board->height || nx < 0 || nx >= board->width) {
+				continue;
+			}
+			if (board->goalDistance[piece][ny][nx] != BOARD_DEAD || !anchor_valid(board, piece, ny, nx)) {
+				continue;
+			}
+			board->goalDistance[piece][ny][nx] = board->goalDistance[piece][y][x] + 1;
+			queueY[tail] = ny;
+			queueX[tail] = nx;
+			tail++;
+		}
+	}
+}
+
+void board_init(board_t *board, gate_t *gate, bool groupInterchangeable) {
+	memset(board, 0, sizeof(board_t));
+	board->height = gate->lines;
+	board->width = gate->num_chars_map / gate->lines;
+	board->numPieces = gate->num_pieces;
+
+	int goalCount = 0;
+	for (int i = 0; i < gate->lines && i < MAX_ROWS; i++) {
+		for (int j = 0; gate->map[i][j] != '\0' && j < MAX_COLUMNS; j++) {
+			char cell = gate->map[i][j];
+			board->wall[i][j] = cell == '#';
+			board->goal[i][j] = cell >= 'G' && cell <= 'Q';
+			if (board->goal[i][j]) {
+				goalCount++;
+			}
+		}
+	}
+
+	for (int p = 0; p < board->numPieces; p++) {
+		read_shape(gate, p, &board->shapes[p]);
+		board->pieceClass[p] = p;
+		if (p == 0 || !groupInterchangeable) {
+			continue;
+		}
+		for (int q = 1; q < p; q++) {
+			if (board->pieceClass[q] == q && same_shape(&board->shapes[p], &board->shapes[q])) {
+				board->pieceClass[p] = q;
+				board->interchangeable++;
+				break;
+			}
+		}
+	}
+
+	board->goalCount = goalCount;
+	for (int p = 0; p < board->numPieces; p++) {
+		compute_goal_distances(board, p, goalCount);
+	}
+
+	uint64_t seed = 0x5A17C0DEULL;
+	for (int p = 0; p < board->numPieces; p++) {
+		if (board->pieceClass[p] != p) {
+			memcpy(board->zobrist[p], board->zobrist[board->pieceClass[p]], sizeof(board->zobrist[p]));
+			continue;
+		}
+		for (int y = 0; y < MAX_ROWS; y++) {
+			for (int x = 0; x < MAX_COLUMNS; x++) {
+				board->zobrist[p][y][x] = next_key(&seed);
+			}
+		}
+	}
+}
+
+void board_stamp(const board_t *board, const int *ys, const int *xs, gate_t *state) {
+	for (int i = 0; i < board->height; i++) {
+		for (int j = 0; state->map[i][j] != '\0'; j++) {
+			if (!board->wall[i][j]) {
+				state->map[i][j] = board->goal[i][j] ? 'G' : ' ';
+			}
+		}
+	}
+	for (int p = 0; p < board->numPieces; p++) {
+		const piece_shape_t *shape = &board->shapes[p];
+		for (int k = 0; k < shape->cellCount; k++) {
+			int y = ys[p] + shape->dy[k];
+			int x = xs[p] + shape->dx[k];
+			state->map[y][x] = board->goal[y][x] ? 'H' + p : '0' + p;
+		}
+		state->piece_y[p] = ys[p];
+		state->piece_x[p] = xs[p];
+	}
+	state->hash = board_hash(board, ys, xs);
+	state->goals_uncovered = board->goalCount - board_goals_covered(board, ys[0], xs[0]);
+}
+
+bool board_position_dead(const board_t *board, int piece, int y, int x) {
+	return board->goalDistance[piece][y][x] == BOARD_DEAD;
+}
+
+int board_goals_covered(const board_t *board, int y, int x) {
+	const piece_shape_t *shape = &board->shapes[0];
+	int covered = 0;
+	for (int k = 0; k < shape->cellCount; k++) {
+		if (board->goal[y + shape->dy[k]][x + shape->dx[k]]) {
+			covered++;
+		}
+	}
+	return covered;
+}
+
+uint64_t board_hash(const board_t *board, const int *ys, const int *xs) {
+	uint64_t hash = 0;
+	for (int p = 0; p < board->numPieces; p++) {
+		hash ^= board->zobrist[p][ys[p]][xs[p]];
+	}
+	return hash;
+}
+
+uint64_t board_rehash(const board_t *board, uint64_t hash, int piece, int fromY, int fromX,
+	int toY, int toX) {
+	return hash ^ board->zobrist[piece][fromY][fromX] ^ board->zobrist[piece][toY][toX];
+}
+
+void board_canonical_positions(const board_t *board, const int *ys, const int *xs,
+	int *outY, int *outX) {
+	for (int p = 0; p < board->numPieces; p++) {
+		outY[p] = ys[p];
+		outX[p] = xs[p];
+	}
+	if (board->interchangeable == 0) {
+		return;
+	}
+
+	/* Insertion sort within each class; classes hold at most MAX_PIECES members. */
+	for (int p = 1; p < board->numPieces; p++) {
+		int cls = board->pieceClass[p];
+		int y = outY[p];
+		int x = outX[p];
+		int slot = p;
+		for (int q = p - 1; q >= cls; q--) {
+			if (board->pieceClass[q] != cls) {
+				continue;
+			}
+			if (outY[q] < y || (outY[q] == y && outX[q] <= x)) {
+				break;
+			}
+			outY[slot] = outY[q];
+			outX[slot] = outX[q];
+			slot = q;
+		}
+		outY[slot] = y;
+		outX[slot] = x;
+	}
+}
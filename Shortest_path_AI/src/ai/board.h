@@ -0,0 +1,87 @@
+/*
+ * Static analysis of a loaded puzzle: the shape of every piece, which
+ * pieces are interchangeable, and which anchor positions can still reach a
+ * goal covering. Computed once after find_pieces() and shared by the search.
+*/
+#ifndef __BOARD__
+#define __BOARD__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "gate.h"
+
+#define BOARD_MAX_CELLS (MAX_ROWS * MAX_COLUMNS)
+
+/* Distance stored for anchor positions from which no goal covering is reachable. */
+#define BOARD_DEAD (-1)
+
+/* Cells of a piece, as offsets from its anchor (topmost, then leftmost cell). */
+typedef struct piece_shape {
+	int cellCount;
+	int dy[BOARD_MAX_CELLS];
+	int dx[BOARD_MAX_CELLS];
+} piece_shape_t;
+
+typedef struct board {
+	int height;
+	int width;
+	int numPieces;
+	piece_shape_t shapes[MAX_PIECES];
+	/* Lowest index of a piece with an identical shape, the piece itself if unique. */
+	int pieceClass[MAX_PIECES];
+	/* Number of pieces which share their shape with a lower-indexed piece. */
+	int interchangeable;
+	bool wall[MAX_ROWS][MAX_COLUMNS];
+	bool goal[MAX_ROWS][MAX_COLUMNS];
+	int goalCount;
+	/*
+		Moves needed for a piece at each anchor position to reach its part of a
+		goal covering on an otherwise empty board (piece 0 on every goal cell,
+		any other piece off all goal cells), or BOARD_DEAD.
+	*/
+	short goalDistance[MAX_PIECES][MAX_ROWS][MAX_COLUMNS];
+	/*
+		Zobrist keys for each piece at each anchor position. Interchangeable
+		pieces share the keys of their class, so the hash of a state does not
+		change when identical pieces are swapped.
+	*/
+	uint64_t zobrist[MAX_PIECES][MAX_ROWS][MAX_COLUMNS];
+} board_t;
+
+/*
+	Reads the shape of every piece from the map and, if groupInterchangeable is
+	set, groups pieces of identical shape. Piece 0 is never grouped as only it
+	may cover the goal.
+*/
+void board_init(board_t *board, gate_t *gate, bool groupInterchangeable);
+
+/*
+	Rewrites the map of state (which must have the board's dimensions) to hold
+	the pieces at the given anchor positions, and updates its piece locations
+	and hash.
+*/
+void board_stamp(const board_t *board, const int *ys, const int *xs, gate_t *state);
+
+/* Whether a piece anchored at (y, x) can never reach its part of a goal covering. */
+bool board_position_dead(const board_t *board, int piece, int y, int x);
+
+/* Number of goal cells covered by piece 0 anchored at (y, x). */
+int board_goals_covered(const board_t *board, int y, int x);
+
+/* Zobrist hash of the pieces at the given anchor positions. */
+uint64_t board_hash(const board_t *board, const int *ys, const int *xs);
+
+/* Hash after moving one piece's anchor from (fromY, fromX) to (toY, toX). */
+uint64_t board_rehash(const board_t *board, uint64_t hash, int piece, int fromY, int fromX,
+	int toY, int toX);
+
+/*
+	Writes the canonical anchor positions of a state to outY/outX: the
+	positions within each group of interchangeable pieces are sorted, so
+	states differing only by a swap of identical pieces coincide.
+*/
+void board_canonical_positions(const board_t *board, const int *ys, const int *xs,
+	int *outY, int *outX);
+
+#endif
@@ -0,0 +1,306 @@
+#include "cache.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define CACHE_PATH_MAX 4096
+#define CACHE_SUFFIX ".sol"
+#define CACHE_SEARCH_MAX 128
+
+/* A cache file found while enforcing the size limit. */
+struct cacheFile {
+    char name[256];
+    long size;
+    struct timespec used;
+};
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+/* FNV-1a, continued from hash over text. */
+static uint64_t hashText(uint64_t hash, const char *text) {
+    for(const unsigned char *c = (const unsigned char *) text; *c; c++) {
+        hash ^= *c;
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+uint64_t hashCacheBoard(const char *board) {
+    return hashText(FNV_OFFSET, board);
+}
+
+/* The options an entry is keyed by, as written on its search line. */
+static void describeSearch(const struct cacheSearch *search, char *text, size_t size) {
+    snprintf(text, size, "algorithm=%d slide=%d symmetry=%d post-optimize=%g", search->algorithm,
+        search->slide ? 1 : 0, search->symmetry ? 1 : 0, search->postOptimize);
+}
+
+static void entryName(const char *board, const struct cacheSearch *search, char *name, size_t size) {
+    char text[CACHE_SEARCH_MAX];
+    describeSearch(search, text, sizeof(text));
+    uint64_t hash = hashText(hashText(FNV_OFFSET, text), board);
+    snprintf(name, size, "%016llx" CACHE_SUFFIX, (unsigned long long) hash);
+}
+
+static void entryPath(const char *dir, const char *board, const struct cacheSearch *search, char *path) {
+    char name[64];
+    entryName(board, search, name, sizeof(name));
+    snprintf(path, CACHE_PATH_MAX, "%s/%s", dir, name);
+}
+
+char *normaliseCacheBoard(char **map, int lines) {
+    size_t total = 1;
+    for(int i = 0; i < lines; i++) {
+        total += strlen(map[i]) + 1;
+    }
+    char *board = (char *) malloc(total);
+    assert(board);
+    size_t used = 0;
+    for(int i = 0; i < lines; i++) {
+        size_t len = strlen(map[i]);
+        while(len > 0 && (map[i][len - 1] == ' ' || map[i][len - 1] == '\t'
+            || map[i][len - 1] == '\n' || map[i][len - 1] == '\r')) {
+            len--;
+        }
+        memcpy(board + used, map[i], len);
+        used += len;
+        board[used++] = '\n';
+    }
+    board[used] = '\0';
+    return board;
+}
+
+/* Reads one "name value" line into value, without the trailing newline. */
+static bool readField(FILE *file, const char *name, char **line, size_t *capacity, const char **value) {
+    ssize_t length = getline(line, capacity, file);
+    if(length <= 0) {
+        return false;
+    }
+    if((*line)[length - 1] == '\n') {
+        (*line)[length - 1] = '\0';
+    }
+    size_t nameLength = strlen(name);
+    if(strncmp(*line, name, nameLength) != 0 || (*line)[nameLength] != ' ') {
+        return false;
+    }
+    *value = *line + nameLength + 1;
+    return true;
+}
+
+bool lookupCachedSolution(const char *dir, const char *board, const struct cacheSearch *search,
+    struct cacheEntry *entry) {
+    char path[CACHE_PATH_MAX];
+    char searchText[CACHE_SEARCH_MAX];
+    entryPath(dir, board, search, path);
+    describeSearch(search, searchText, sizeof(searchText));
+    FILE *file = fopen(path, "r");
+    if(! file) {
+        return false;
+    }
+
+    bool hit = false;
+    char *line = NULL;
+    size_t capacity = 0;
+    const char *value = NULL;
+    char *storedBoard = NULL;
+    entry->solution = NULL;
+
+    if(! readField(file, "gate-cache", &line, &capacity, &value) || atoi(value) != CACHE_VERSION) {
+        goto lookupDone;
+    }
+    if(! readField(file, "search", &line, &capacity, &value) || strcmp(value, searchText) != 0) {
+        goto lookupDone;
+    }
+    if(! readField(file, "algorithm", &line, &capacity, &value)) {
+        goto lookupDone;
+    }
+    entry->algorithm = atoi(value);
+    if(! readField(file, "width", &line, &capacity, &value)) {
+        goto lookupDone;
+    }
+    entry->width = atoi(value);
+    if(! readField(file, "layers", &line, &capacity, &value)) {
+        goto lookupDone;
+    }
+    entry->layers = atoi(value);
+    if(! readField(file, "expanded", &line, &capacity, &value)) {
+        goto lookupDone;
+    }
+    entry->expanded = atol(value);
+    if(! readField(file, "generated", &line, &capacity, &value)) {
+        goto lookupDone;
+    }
+    entry->generated = atol(value);
+    if(! readField(file, "duplicated", &line, &capacity, &value)) {
+        goto lookupDone;
+    }
+    entry->duplicated = atol(value);
+    if(! readField(file, "elapsed", &line, &capacity, &value)) {
+        goto lookupDone;
+    }
+    entry->elapsed = atof(value);
+    if(! readField(file, "solution", &line, &capacity, &value)) {
+        goto lookupDone;
+    }
+    entry->solution = strdup(value);
+    assert(entry->solution);
+    if(! readField(file, "board", &line, &capacity, &value)) {
+        goto lookupDone;
+    }
+    size_t boardLength = (size_t) atol(value);
+    if(boardLength != strlen(board)) {
+        goto lookupDone;
+    }
+    storedBoard = (char *) malloc(boardLength + 1);
+    assert(storedBoard);
+    if(fread(storedBoard, 1, boardLength, file) != boardLength) {
+        goto lookupDone;
+    }
+    hit = memcmp(storedBoard, board, boardLength) == 0;
+
+lookupDone:
+    fclose(file);
+    if(line) {
+        free(line);
+    }
+    if(storedBoard) {
+        free(storedBoard);
+    }
+    if(! hit) {
+        freeCacheEntry(entry);
+        return false;
+    }
+    /* Recency for eviction is the modification time. */
+    utimensat(AT_FDCWD, path, NULL, 0);
+    return true;
+}
+
+static int compareUsed(const void *a, const void *b) {
+    const struct cacheFile *fa = (const struct cacheFile *) a;
+    const struct cacheFile *fb = (const struct cacheFile *) b;
+    if(fa->used.tv_sec != fb->used.tv_sec) {
+        return fa->used.tv_sec < fb->used.tv_sec ? -1 : 1;
+    }
+    if(fa->used.tv_nsec != fb->used.tv_nsec) {
+        return fa->used.tv_nsec < fb->used.tv_nsec ? -1 : 1;
+    }
+    return 0;
+}
+
+/* Removes the least recently used entries, other than keep, until at most limitBytes remain. */
+static void evictEntries(const char *dir, const char *keep, long limitBytes) {
+    DIR *listing = opendir(dir);
+    if(! listing) {
+        return;
+    }
+    struct cacheFile *files = NULL;
+    int fileCount = 0;
+    int fileCapacity = 0;
+    long total = 0;
+    char path[CACHE_PATH_MAX];
+    struct dirent *item;
+    while((item = readdir(listing)) != NULL) {
+        size_t nameLength = strlen(item->d_name);
+        if(nameLength <= strlen(CACHE_SUFFIX) || nameLength >= sizeof(files[0].name)
+            || strcmp(item->d_name + nameLength - strlen(CACHE_SUFFIX), CACHE_SUFFIX) != 0) {
+            continue;
+        }
+        struct stat info;
+        snprintf(path, sizeof(path), "%s/%s", dir, item->d_name);
+        if(stat(path, &info) != 0) {
+            /* Removed by another process since it was listed. */
+            continue;
+        }
+        if(fileCount == fileCapacity) {
+            fileCapacity = fileCapacity ? fileCapacity * 2 : 64;
+            files = (struct cacheFile *) realloc(files, fileCapacity * sizeof(struct cacheFile));
+            assert(files);
+        }
+        strcpy(files[fileCount].name, item->d_name);
+        files[fileCount].size = (long) info.st_size;
+        files[fileCount].used = info.st_mtim;
+        total += files[fileCount].size;
+        fileCount++;
+    }
+    closedir(listing);
+
+    if(total > limitBytes) {
+        qsort(files, fileCount, sizeof(struct cacheFile), compareUsed);
+        for(int i = 0; i < fileCount && total > limitBytes; i++) {
+            if(strcmp(files[i].name, keep) == 0) {
+                continue;
+            }
+            snprintf(path, sizeof(path), "%s/%s", dir, files[i].name);
+            unlink(path);
+            total -= files[i].size;
+        }
+    }
+    if(files) {
+        free(files);
+    }
+}
+
+bool storeCachedSolution(const char *dir, const char *board, const struct cacheSearch *search,
+    const struct cacheEntry *entry, long limitBytes) {
+    static int instance = 0;
+    char temporary[CACHE_PATH_MAX];
+    char path[CACHE_PATH_MAX];
+    char name[64];
+    char searchText[CACHE_SEARCH_MAX];
+
+    mkdir(dir, 0755);
+    entryName(board, search, name, sizeof(name));
+    describeSearch(search, searchText, sizeof(searchText));
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    snprintf(temporary, sizeof(temporary), "%s/.tmp-%ld-%d", dir, (long) getpid(), instance++);
+
+    FILE *file = fopen(temporary, "w");
+    if(! file) {
+        return false;
+    }
+    fprintf(file, "gate-cache %d\n", CACHE_VERSION);
+    fprintf(file, "search %s\n", searchText);
+    fprintf(file, "algorithm %d\n", entry->algorithm);
+    fprintf(file, "width %d\n", entry->width);
+    fprintf(file, "layers %d\n", entry->layers);
+    fprintf(file, "expanded %ld\n", entry->expanded);
+    fprintf(file, "generated %ld\n", entry->generated);
+    fprintf(file, "duplicated %ld\n", entry->duplicated);
+    fprintf(file, "elapsed %lf\n", entry->elapsed);
+    fprintf(file, "solution %s\n", entry->solution ? entry->solution : "");
+    fprintf(file, "board %ld\n", (long) strlen(board));
+    fputs(board, file);
+    bool ok = ! ferror(file) && fflush(file) == 0 && fsync(fileno(file)) == 0;
+    if(fclose(file) != 0) {
+        ok = false;
+    }
+    /* The rename is atomic, so readers see either the old entry or the new one. */
+    if(! ok || rename(temporary, path) != 0) {
+        unlink(temporary);
+        return false;
+    }
+
+    evictEntries(dir, name, limitBytes);
+    return true;
+}
+
+void dropCachedSolution(const char *dir, const char *board, const struct cacheSearch *search) {
+    char path[CACHE_PATH_MAX];
+    entryPath(dir, board, search, path);
+    unlink(path);
+}
+
+void freeCacheEntry(struct cacheEntry *entry) {
+    if(entry->solution) {
+        free(entry->solution);
+        entry->solution = NULL;
+    }
+}
@@ -0,0 +1,73 @@
+/*
+ * Content-addressed cache of solved puzzles on disk. Each entry is a file in
+ * the cache directory named after a hash of the normalised board and the
+ * search options, holding both (to rule out hash collisions), the solution,
+ * and the statistics of the search that found it. An entry only answers a
+ * request with the same options, so an IW plan never stands in for an
+ * optimal one. Entries are written
+ * to a temporary file and renamed into place, so concurrent readers only
+ * ever see complete entries and concurrent writers of the same board simply
+ * replace each other.
+*/
+#ifndef __CACHE__
+#define __CACHE__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Version written to and required of cache entries. */
+#define CACHE_VERSION (2)
+
+/* Options that change which solution a search returns. */
+struct cacheSearch {
+    int algorithm;
+    bool slide;
+    bool symmetry;
+    /* Seconds of --post-optimize, 0 when off. */
+    double postOptimize;
+};
+
+struct cacheEntry {
+    int algorithm;
+    /* IW width that found the solution, 0 for UCS and the other algorithms. */
+    int width;
+    int layers;
+    long expanded;
+    long generated;
+    long duplicated;
+    double elapsed;
+    char *solution;
+};
+
+/*
+	Returns the board as text, one map line per line with trailing whitespace
+	removed, which is what entries are keyed and compared by.
+*/
+char *normaliseCacheBoard(char **map, int lines);
+
+/* FNV-1a hash of a normalised board, which entries are named after. */
+uint64_t hashCacheBoard(const char *board);
+
+/*
+	Looks up a normalised board solved with the given options. On a hit,
+	fills entry (whose solution must be freed with freeCacheEntry) and marks
+	the entry as recently used.
+*/
+bool lookupCachedSolution(const char *dir, const char *board, const struct cacheSearch *search,
+	struct cacheEntry *entry);
+
+/*
+	Stores the entry for a normalised board, then removes least recently used
+	entries until the cache holds at most limitBytes. Returns false if the
+	entry could not be written.
+*/
+bool storeCachedSolution(const char *dir, const char *board, const struct cacheSearch *search,
+	const struct cacheEntry *entry, long limitBytes);
+
+/* Removes the entry for a normalised board, e.g. once it fails verification. */
+void dropCachedSolution(const char *dir, const char *board, const struct cacheSearch *search);
+
+/* Frees the solution held by an entry. */
+void freeCacheEntry(struct cacheEntry *entry);
+
+#endif
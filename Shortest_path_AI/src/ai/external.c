@@ -0,0 +1,420 @@
+#include "external.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/* Buffer size used for every sequential file stream. */
+#define EXT_IO_BUFFER (1 << 20)
+/* Candidates the buffer starts with; it doubles as needed up to bufferCapacity. */
+#define EXT_INITIAL_RECORDS 1024
+#define EXT_PATH_MAX 4096
+
+struct externalLayers {
+    /* Leaves room in EXT_PATH_MAX for the file names below it. */
+    char dir[EXT_PATH_MAX - 64];
+    int keyBytes;
+    /* Key followed by a 4 byte parent index. */
+    size_t recordBytes;
+
+    unsigned char *buffer;
+    size_t bufferCapacity;
+    size_t bufferAllocated;
+    size_t bufferUsed;
+    long bufferDuplicates;
+
+    int runCount;
+    int layerCount;
+    FILE *reader;
+    long bytesWritten;
+
+    /* Heap and stream buffer bytes held now, and the most ever held at once. */
+    size_t memoryBytes;
+    size_t peakMemoryBytes;
+};
+
+/* A sorted file read one record at a time. */
+struct sortedStream {
+    FILE *file;
+    unsigned char *record;
+    size_t recordBytes;
+    bool valid;
+};
+
+static void noteAllocated(struct externalLayers *layers, size_t bytes) {
+    layers->memoryBytes += bytes;
+    if(layers->memoryBytes > layers->peakMemoryBytes) {
+        layers->peakMemoryBytes = layers->memoryBytes;
+    }
+}
+
+static void noteFreed(struct externalLayers *layers, size_t bytes) {
+    layers->memoryBytes -= bytes;
+}
+
+/* Key width for qsort, which takes no context argument. */
+static int sortKeyBytes;
+
+static int compareRecords(const void *a, const void *b) {
+    return memcmp(a, b, sortKeyBytes);
+}
+
+static void layerPath(struct externalLayers *layers, char *path, int layer, const char *suffix) {
+    snprintf(path, EXT_PATH_MAX, "%s/layer-%d.%s", layers->dir, layer, suffix);
+}
+
+static void runPath(struct externalLayers *layers, char *path, int run) {
+    snprintf(path, EXT_PATH_MAX, "%s/run-%d", layers->dir, run);
+}
+
+static FILE *openStream(const char *path, const char *mode) {
+    FILE *file = fopen(path, mode);
+    if(file) {
+        setvbuf(file, NULL, _IOFBF, EXT_IO_BUFFER);
+    }
+    return file;
+}
+
+static bool openSorted(struct sortedStream *stream, const char *path, size_t recordBytes) {
+    stream->recordBytes = recordBytes;
+    stream->valid = false;
+    stream->record = (unsigned char *) malloc(recordBytes);
+    stream->file = openStream(path, "rb");
+    if(! stream->record || ! stream->file) {
+        return false;
+    }
+    stream->valid = fread(stream->record, recordBytes, 1, stream->file) == 1;
+    return true;
+}
+
+static void advanceSorted(struct sortedStream *stream) {
+    stream->valid = fread(stream->record, stream->recordBytes, 1, stream->file) == 1;
+}
+
+static void closeSorted(struct sortedStream *stream) {
+    if(stream->file) {
+        fclose(stream->file);
+    }
+    if(stream->record) {
+        free(stream->record);
+    }
+    stream->file = NULL;
+    stream->record = NULL;
+    stream->valid = false;
+}
+
+struct externalLayers *getNewExternalLayers(const char *scratchDir, int keyBytes, size_t bufferBytes) {
+    static int instance = 0;
+    struct externalLayers *layers = (struct externalLayers *) malloc(sizeof(struct externalLayers));
+    assert(layers);
+
+    snprintf(layers->dir, sizeof(layers->dir), "%s/gate-bfs-%ld-%d", scratchDir, (long) getpid(), instance++);
+    if(mkdir(layers->dir, 0700) != 0) {
+        free(layers);
+        return NULL;
+    }
+
+    layers->keyBytes = keyBytes;
+    layers->recordBytes = keyBytes + sizeof(uint32_t);
+    layers->bufferCapacity = bufferBytes / layers->recordBytes;
+    if(layers->bufferCapacity < 1024) {
+        layers->bufferCapacity = 1024;
+    }
+    layers->bufferAllocated = EXT_INITIAL_RECORDS;
+    layers->buffer = (unsigned char *) malloc(layers->bufferAllocated * layers->recordBytes);
+    assert(layers->buffer);
+    layers->bufferUsed = 0;
+    layers->bufferDuplicates = 0;
+    layers->runCount = 0;
+    layers->layerCount = 0;
+    layers->reader = NULL;
+    layers->bytesWritten = 0;
+    layers->memoryBytes = 0;
+    layers->peakMemoryBytes = 0;
+    noteAllocated(layers, sizeof(struct externalLayers) + layers->bufferAllocated * layers->recordBytes);
+
+    return layers;
+}
+
+/* Sorts the buffered candidates, drops repeats and writes them as a run. */
+static bool spillRun(struct externalLayers *layers) {
+    if(layers->bufferUsed == 0) {
+        return true;
+    }
+    sortKeyBytes = layers->keyBytes;
+    qsort(layers->buffer, layers->bufferUsed, layers->recordBytes, compareRecords);
+
+    char path[EXT_PATH_MAX];
+    runPath(layers, path, layers->runCount);
+    FILE *run = openStream(path, "wb");
+    if(! run) {
+        return false;
+    }
+    noteAllocated(layers, EXT_IO_BUFFER);
+    unsigned char *previous = NULL;
+    for(size_t i = 0; i < layers->bufferUsed; i++) {
+        unsigned char *record = layers->buffer + i * layers->recordBytes;
+        if(previous && memcmp(previous, record, layers->keyBytes) == 0) {
+            layers->bufferDuplicates++;
+            continue;
+        }
+        if(fwrite(record, layers->recordBytes, 1, run) != 1) {
+            fclose(run);
+            noteFreed(layers, EXT_IO_BUFFER);
+            return false;
+        }
+        layers->bytesWritten += layers->recordBytes;
+        previous = record;
+    }
+    fclose(run);
+    noteFreed(layers, EXT_IO_BUFFER);
+    layers->runCount++;
+    layers->bufferUsed = 0;
+    return true;
+}
+
+bool addExternalCandidate(struct externalLayers *layers, const unsigned char *key, uint32_t parentIndex) {
+    if(layers->bufferUsed == layers->bufferAllocated && layers->bufferAllocated < layers->bufferCapacity) {
+        size_t grown = layers->bufferAllocated * 2;
+        if(grown > layers->bufferCapacity) {
+            grown = layers->bufferCapacity;
+        }
+        unsigned char *buffer = (unsigned char *) realloc(layers->buffer, grown * layers->recordBytes);
+        if(buffer) {
+            noteAllocated(layers, (grown - layers->bufferAllocated) * layers->recordBytes);
+            layers->buffer = buffer;
+            layers->bufferAllocated = grown;
+        }
+    }
+    if(layers->bufferUsed == layers->bufferAllocated && ! spillRun(layers)) {
+        return false;
+    }
+    unsigned char *record = layers->buffer + layers->bufferUsed * layers->recordBytes;
+    memcpy(record, key, layers->keyBytes);
+    memcpy(record + layers->keyBytes, &parentIndex, sizeof(uint32_t));
+    layers->bufferUsed++;
+    return true;
+}
+
+/* Advances a previous-layer stream up to key; true if the key is present in it. */
+static bool seekSorted(struct sortedStream *stream, const unsigned char *key, int keyBytes) {
+    while(stream->valid) {
+        int cmp = memcmp(stream->record, key, keyBytes);
+        if(cmp == 0) {
+            return true;
+        }
+        if(cmp > 0) {
+            return false;
+        }
+        advanceSorted(stream);
+    }
+    return false;
+}
+
+long finishExternalLayer(struct externalLayers *layers, long *duplicates) {
+    if(! spillRun(layers)) {
+        return -1;
+    }
+    *duplicates += layers->bufferDuplicates;
+    layers->bufferDuplicates = 0;
+
+    char path[EXT_PATH_MAX];
+    long kept = -1;
+    int runCount = layers->runCount;
+    struct sortedStream *runs = (struct sortedStream *) calloc(runCount > 0 ? runCount : 1, sizeof(struct sortedStream));
+    struct sortedStream previous[2];
+    memset(previous, 0, sizeof(previous));
+    unsigned char *lastKey = (unsigned char *) malloc(layers->keyBytes);
+    FILE *keysOut = NULL;
+    FILE *parentsOut = NULL;
+    /* Every run and both previous layers are read at once, while two files are written. */
+    size_t mergeBytes = (runCount > 0 ? runCount : 1) * sizeof(struct sortedStream) + layers->keyBytes
+        + runCount * (layers->recordBytes + EXT_IO_BUFFER) + 2 * (layers->keyBytes + EXT_IO_BUFFER)
+        + 2 * EXT_IO_BUFFER;
+    noteAllocated(layers, mergeBytes);
+    if(! runs || ! lastKey) {
+        goto cleanup;
+    }
+
+    for(int r = 0; r < runCount; r++) {
+        runPath(layers, path, r);
+        if(! openSorted(&runs[r], path, layers->recordBytes)) {
+            goto cleanup;
+        }
+    }
+    /* In an undirected graph, layer n + 1 can only repeat layers n and n - 1. */
+    for(int p = 0; p < 2; p++) {
+        int layer = layers->layerCount - 1 - p;
+        if(layer < 0) {
+            continue;
+        }
+        layerPath(layers, path, layer, "keys");
+        if(! openSorted(&previous[p], path, layers->keyBytes)) {
+            goto cleanup;
+        }
+    }
+
+    layerPath(layers, path, layers->layerCount, "keys");
+    keysOut = openStream(path, "wb");
+    layerPath(layers, path, layers->layerCount, "parents");
+    parentsOut = openStream(path, "wb");
+    if(! keysOut || ! parentsOut) {
+        goto cleanup;
+    }
+
+    kept = 0;
+    bool haveLast = false;
+    while(true) {
+        /* Smallest head among the runs; run counts stay small so a scan suffices. */
+        int best = -1;
+        for(int r = 0; r < runCount; r++) {
+            if(runs[r].valid && (best == -1
+                || memcmp(runs[r].record, runs[best].record, layers->keyBytes) < 0)) {
+                best = r;
+            }
+        }
+        if(best == -1) {
+            break;
+        }
+        unsigned char *record = runs[best].record;
+        bool duplicate = haveLast && memcmp(lastKey, record, layers->keyBytes) == 0;
+        if(! duplicate) {
+            memcpy(lastKey, record, layers->keyBytes);
+            haveLast = true;
+            duplicate = seekSorted(&previous[0], record, layers->keyBytes)
+                || seekSorted(&previous[1], record, layers->keyBytes);
+        }
+        if(duplicate) {
+            (*duplicates)++;
+        } else {
+            if(fwrite(record, layers->keyBytes, 1, keysOut) != 1
+                || fwrite(record + layers->keyBytes, sizeof(uint32_t), 1, parentsOut) != 1) {
+                kept = -1;
+                goto cleanup;
+            }
+            layers->bytesWritten += layers->recordBytes;
+            kept++;
+        }
+        advanceSorted(&runs[best]);
+    }
+    layers->layerCount++;
+
+cleanup:
+    if(keysOut) {
+        fclose(keysOut);
+    }
+    if(parentsOut) {
+        fclose(parentsOut);
+    }
+    for(int p = 0; p < 2; p++) {
+        closeSorted(&previous[p]);
+    }
+    if(runs) {
+        for(int r = 0; r < runCount; r++) {
+            closeSorted(&runs[r]);
+            runPath(layers, path, r);
+            unlink(path);
+        }
+        free(runs);
+    }
+    if(lastKey) {
+        free(lastKey);
+    }
+    noteFreed(layers, mergeBytes);
+    layers->runCount = 0;
+    return kept;
+}
+
+int queryExternalLayerCount(struct externalLayers *layers) {
+    return layers->layerCount;
+}
+
+bool beginExternalLayerRead(struct externalLayers *layers, int layer) {
+    if(layers->reader) {
+        fclose(layers->reader);
+        layers->reader = NULL;
+        noteFreed(layers, EXT_IO_BUFFER);
+    }
+    if(layer < 0 || layer >= layers->layerCount) {
+        return false;
+    }
+    char path[EXT_PATH_MAX];
+    layerPath(layers, path, layer, "keys");
+    layers->reader = openStream(path, "rb");
+    if(! layers->reader) {
+        return false;
+    }
+    noteAllocated(layers, EXT_IO_BUFFER);
+    return true;
+}
+
+bool readExternalState(struct externalLayers *layers, unsigned char *key) {
+    if(! layers->reader) {
+        return false;
+    }
+    if(fread(key, layers->keyBytes, 1, layers->reader) != 1) {
+        fclose(layers->reader);
+        layers->reader = NULL;
+        noteFreed(layers, EXT_IO_BUFFER);
+        return false;
+    }
+    return true;
+}
+
+bool readExternalRecord(struct externalLayers *layers, int layer, long index, unsigned char *key,
+    uint32_t *parentIndex) {
+    char path[EXT_PATH_MAX];
+    bool ok = false;
+    layerPath(layers, path, layer, "keys");
+    FILE *keys = fopen(path, "rb");
+    layerPath(layers, path, layer, "parents");
+    FILE *parents = fopen(path, "rb");
+    if(keys && parents
+        && fseek(keys, index * layers->keyBytes, SEEK_SET) == 0
+        && fseek(parents, index * (long) sizeof(uint32_t), SEEK_SET) == 0
+        && fread(key, layers->keyBytes, 1, keys) == 1
+        && fread(parentIndex, sizeof(uint32_t), 1, parents) == 1) {
+        ok = true;
+    }
+    if(keys) {
+        fclose(keys);
+    }
+    if(parents) {
+        fclose(parents);
+    }
+    return ok;
+}
+
+long queryExternalBytesWritten(struct externalLayers *layers) {
+    return layers->bytesWritten;
+}
+
+size_t queryExternalMemoryUsage(struct externalLayers *layers) {
+    return layers->peakMemoryBytes;
+}
+
+void freeExternalLayers(struct externalLayers *layers) {
+    if(! layers) {
+        return;
+    }
+    if(layers->reader) {
+        fclose(layers->reader);
+    }
+    char path[EXT_PATH_MAX];
+    for(int layer = 0; layer <= layers->layerCount; layer++) {
+        layerPath(layers, path, layer, "keys");
+        unlink(path);
+        layerPath(layers, path, layer, "parents");
+        unlink(path);
+    }
+    for(int r = 0; r < layers->runCount; r++) {
+        runPath(layers, path, r);
+        unlink(path);
+    }
+    rmdir(layers->dir);
+    free(layers->buffer);
+    free(layers);
+}
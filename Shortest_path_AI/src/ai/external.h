@@ -0,0 +1,58 @@
+/*
+ * Disk-backed breadth-first layers with delayed duplicate detection.
+ * Each layer is a file of fixed-width packed states in sorted order, with a
+ * side file holding the index of each state's parent in the previous layer.
+ * Candidates for the next layer are buffered in memory, spilled as sorted
+ * runs, then merged and subtracted against the previous two layers using
+ * large sequential reads and writes only.
+*/
+#ifndef __EXTERNAL__
+#define __EXTERNAL__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+struct externalLayers;
+
+/*
+	Creates an empty layer store in a fresh directory below scratchDir.
+	bufferBytes bounds the memory used to collect candidates before a sorted
+	run is written out. Returns NULL if the directory cannot be created.
+*/
+struct externalLayers *getNewExternalLayers(const char *scratchDir, int keyBytes, size_t bufferBytes);
+
+/* Adds a candidate for the layer being built. */
+bool addExternalCandidate(struct externalLayers *layers, const unsigned char *key, uint32_t parentIndex);
+
+/*
+	Completes the layer being built: merges its runs, removes states repeated
+	within it or present in the previous two layers, and writes it out.
+	Returns the number of states kept, or -1 on an I/O error. duplicates is
+	increased by the number removed.
+*/
+long finishExternalLayer(struct externalLayers *layers, long *duplicates);
+
+/* Number of completed layers. */
+int queryExternalLayerCount(struct externalLayers *layers);
+
+/* Opens a completed layer for sequential reading. */
+bool beginExternalLayerRead(struct externalLayers *layers, int layer);
+
+/* Reads the next state of the open layer, false at its end. */
+bool readExternalState(struct externalLayers *layers, unsigned char *key);
+
+/* Reads a single state and its parent index from a completed layer. */
+bool readExternalRecord(struct externalLayers *layers, int layer, long index, unsigned char *key,
+	uint32_t *parentIndex);
+
+/* Total bytes written to scratch files. */
+long queryExternalBytesWritten(struct externalLayers *layers);
+
+/* Most bytes of candidate buffer, merge state and stream buffers held at once. */
+size_t queryExternalMemoryUsage(struct externalLayers *layers);
+
+/* Removes all scratch files and frees the store. */
+void freeExternalLayers(struct externalLayers *layers);
+
+#endif
@@ -3,6 +3,7 @@
 */
 
 #include <assert.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -12,6 +13,121 @@
 
 #include "hashtable.h"
 
+/*
+ * Hashing after wyhash: key words are folded pairwise with 64x64->128 bit
+ * multiplies, whose halves are XORed together. Keys of 8, 16 and 32 bytes
+ * have straight-line paths; any other size reads overlapping words instead
+ * of looping over bytes.
+ */
+static const uint64_t _ht_secret[4] = {
+	0xa0761d6478bd642full, 0xe7037ed1a0b428dbull, 0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull
+};
+
+static inline uint64_t _ht_mum(uint64_t a, uint64_t b) {
+	__uint128_t product = (__uint128_t)a * b;
+	return (uint64_t)product ^ (uint64_t)(product >> 64);
+}
+
+static inline uint64_t _ht_read64(const unsigned char* p) {
+	uint64_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static inline uint64_t _ht_read32(const unsigned char* p) {
+	uint32_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static inline uint64_t _ht_finish(uint64_t a, uint64_t b, uint64_t seed, size_t length) {
+	__uint128_t product = (__uint128_t)(a ^ _ht_secret[1]) * (b ^ seed);
+	a = (uint64_t)product;
+	b = (uint64_t)(product >> 64);
+	return _ht_mum(a ^ _ht_secret[0] ^ length, b ^ _ht_secret[1]);
+}
+
+static inline uint64_t _ht_hash_8(const unsigned char* p) {
+	uint64_t word = _ht_read64(p);
+	return _ht_finish(word, (word << 32) | (word >> 32), _ht_secret[0], 8);
+}
+
+static inline uint64_t _ht_hash_16(const unsigned char* p) {
+	return _ht_finish(_ht_read64(p), _ht_read64(p + 8), _ht_secret[0], 16);
+}
+
+static inline uint64_t _ht_hash_32(const unsigned char* p) {
+	uint64_t seed = _ht_mum(_ht_read64(p) ^ _ht_secret[1], _ht_read64(p + 8) ^ _ht_secret[0]);
+	return _ht_finish(_ht_read64(p + 16), _ht_read64(p + 24), seed, 32);
+}
+
+static inline uint64_t _ht_wyhash(const void* key, size_t length) {
+	const unsigned char* p = key;
+	uint64_t seed = _ht_secret[0];
+	uint64_t a;
+	uint64_t b;
+
+	if (length <= 16) {
+		if (length >= 4) {
+			/* Two overlapping pairs of 4 byte reads cover any length from 4 to 16. */
+			size_t middle = (length >> 3) << 2;
+			a = (_ht_read32(p) << 32) | _ht_read32(p + middle);
+			b = (_ht_read32(p + length - 4) << 32) | _ht_read32(p + length - 4 - middle);
+		} else if (length > 0) {
+			a = ((uint64_t)p[0] << 16) | ((uint64_t)p[length >> 1] << 8) | p[length - 1];
+			b = 0;
+		} else {
+			a = 0;
+			b = 0;
+		}
+	} else {
+		size_t remaining = length;
+		while (remaining > 16) {
+			seed = _ht_mum(_ht_read64(p) ^ _ht_secret[1], _ht_read64(p + 8) ^ seed);
+			p += 16;
+			remaining -= 16;
+		}
+		a = _ht_read64(p + remaining - 16);
+		b = _ht_read64(p + remaining - 8);
+	}
+
+	return _ht_finish(a, b, seed, length);
+}
+
+/* Hash of key, inline when the table uses the default hash. */
+static inline size_t _ht_key_hash(const HashTable* table, void* key) {
+	if (table->hash != _ht_default_hash) {
+		return table->hash(key, table->key_size);
+	}
+	switch (table->key_size) {
+	case 8:
+		return _ht_hash_8(key);
+	case 16:
+		return _ht_hash_16(key);
+	case 32:
+		return _ht_hash_32(key);
+	default:
+		return _ht_wyhash(key, table->key_size);
+	}
+}
+
+/* Keys compared a word at a time, with overlapping reads for the last partial word. */
+static inline bool _ht_keys_equal(const void* first_key, const void* second_key, size_t key_size) {
+	const unsigned char* first = first_key;
+	const unsigned char* second = second_key;
+	size_t offset;
+
+	if (key_size < 8) {
+		return memcmp(first, second, key_size) == 0;
+	}
+	for (offset = 0; offset + 8 < key_size; offset += 8) {
+		if (_ht_read64(first + offset) != _ht_read64(second + offset)) {
+			return false;
+		}
+	}
+	return _ht_read64(first + key_size - 8) == _ht_read64(second + key_size - 8);
+}
+
 int ht_setup(HashTable* table,
 						 size_t key_size,
 						 size_t value_size,
@@ -33,6 +149,9 @@ int ht_setup(HashTable* table,
 	table->hash = _ht_default_hash;
 	table->compare = _ht_default_compare;
 	table->size = 0;
+	table->old_nodes = NULL;
+	table->old_capacity = 0;
+	table->old_next = 0;
 
 	return HT_SUCCESS;
 }
@@ -47,6 +166,9 @@ int ht_copy(HashTable* first, HashTable* second) {
 	if (first == NULL) return HT_ERROR;
 	if (!ht_is_initialized(second)) return HT_ERROR;
 
+	/* Copies chain by chain, so every entry must be in the current array. */
+	_ht_migrate(second, SIZE_MAX);
+
 	if (_ht_allocate(first, second->capacity) == HT_ERROR) {
 		return HT_ERROR;
 	}
@@ -56,6 +178,9 @@ int ht_copy(HashTable* first, HashTable* second) {
 	first->hash = second->hash;
 	first->compare = second->compare;
 	first->size = second->size;
+	first->old_nodes = NULL;
+	first->old_capacity = 0;
+	first->old_next = 0;
 
 	for (chain = 0; chain < second->capacity; ++chain) {
 		for (node = second->nodes[chain]; node; node = node->next) {
@@ -77,6 +202,7 @@ int ht_move(HashTable* first, HashTable* second) {
 
 	*first = *second;
 	second->nodes = NULL;
+	second->old_nodes = NULL;
 
 	return HT_SUCCESS;
 }
@@ -91,9 +217,14 @@ int ht_swap(HashTable* first, HashTable* second) {
 	_ht_int_swap(&first->key_size, &second->key_size);
 	_ht_int_swap(&first->value_size, &second->value_size);
 	_ht_int_swap(&first->size, &second->size);
+	_ht_int_swap(&first->threshold, &second->threshold);
+	_ht_int_swap(&first->capacity, &second->capacity);
+	_ht_int_swap(&first->old_capacity, &second->old_capacity);
+	_ht_int_swap(&first->old_next, &second->old_next);
 	_ht_pointer_swap((void**)&first->hash, (void**)&second->hash);
 	_ht_pointer_swap((void**)&first->compare, (void**)&second->compare);
 	_ht_pointer_swap((void**)&first->nodes, (void**)&second->nodes);
+	_ht_pointer_swap((void**)&first->old_nodes, (void**)&second->old_nodes);
 
 	return HT_SUCCESS;
 }
@@ -114,8 +245,18 @@ int ht_destroy(HashTable* table) {
 			node = next;
 		}
 	}
+	for (chain = table->old_next; table->old_nodes && chain < table->old_capacity; ++chain) {
+		node = table->old_nodes[chain];
+		while (node) {
+			next = node->next;
+			_ht_destroy_node(node);
+			node = next;
+		}
+	}
 
 	free(table->nodes);
+	free(table->old_nodes);
+	table->old_nodes = NULL;
 
 	return HT_SUCCESS;
 }
@@ -133,15 +274,15 @@ int ht_insert(HashTable* table, void* key, void* value) {
 	if (_ht_should_grow(table)) {
 		_ht_adjust_capacity(table);
 	}
+	_ht_migrate(table, HT_MIGRATION_STEP);
 
-	index = _ht_hash(table, key);
-	for (node = table->nodes[index]; node; node = node->next) {
-		if (_ht_equal(table, key, node->key)) {
-			memcpy(node->value, value, table->value_size);
-			return HT_UPDATED;
-		}
+	if ((node = _ht_find(table, key)) != NULL) {
+		memcpy(node->value, value, table->value_size);
+		return HT_UPDATED;
 	}
 
+	/* New entries always go into the current array. */
+	index = _ht_hash(table, key);
 	if (_ht_push_front(table, index, key, value) == HT_ERROR) {
 		return HT_ERROR;
 	}
@@ -152,28 +293,19 @@ int ht_insert(HashTable* table, void* key, void* value) {
 }
 
 int ht_contains(HashTable* table, void* key) {
-	size_t index;
-	HTNode* node;
-
 	assert(ht_is_initialized(table));
 	assert(key != NULL);
 
 	if (!ht_is_initialized(table)) return HT_ERROR;
 	if (key == NULL) return HT_ERROR;
 
-	index = _ht_hash(table, key);
-	for (node = table->nodes[index]; node; node = node->next) {
-		if (_ht_equal(table, key, node->key)) {
-			return HT_FOUND;
-		}
-	}
+	_ht_migrate(table, HT_MIGRATION_STEP);
 
-	return HT_NOT_FOUND;
+	return _ht_find(table, key) ? HT_FOUND : HT_NOT_FOUND;
 }
 
 void* ht_lookup(HashTable* table, void* key) {
 	HTNode* node;
-	size_t index;
 
 	assert(table != NULL);
 	assert(key != NULL);
@@ -181,19 +313,14 @@ void* ht_lookup(HashTable* table, void* key) {
 	if (table == NULL) return NULL;
 	if (key == NULL) return NULL;
 
-	index = _ht_hash(table, key);
-	for (node = table->nodes[index]; node; node = node->next) {
-		if (_ht_equal(table, key, node->key)) {
-			return node->value;
-		}
-	}
+	_ht_migrate(table, HT_MIGRATION_STEP);
 
-	return NULL;
+	node = _ht_find(table, key);
+	return node ? node->value : NULL;
 }
 
 const void* ht_const_lookup(const HashTable* table, void* key) {
 	const HTNode* node;
-	size_t index;
 
 	assert(table != NULL);
 	assert(key != NULL);
@@ -201,20 +328,15 @@ const void* ht_const_lookup(const HashTable* table, void* key) {
 	if (table == NULL) return NULL;
 	if (key == NULL) return NULL;
 
-	index = _ht_hash(table, key);
-	for (node = table->nodes[index]; node; node = node->next) {
-		if (_ht_equal(table, key, node->key)) {
-			return node->value;
-		}
-	}
-
-	return NULL;
+	node = _ht_find(table, key);
+	return node ? node->value : NULL;
 }
 
 int ht_erase(HashTable* table, void* key) {
 	HTNode* node;
 	HTNode* previous;
-	size_t index;
+	HTNode** chain;
+	size_t hash;
 
 	assert(table != NULL);
 	assert(key != NULL);
@@ -222,15 +344,25 @@ int ht_erase(HashTable* table, void* key) {
 	if (table == NULL) return HT_ERROR;
 	if (key == NULL) return HT_ERROR;
 
-	index = _ht_hash(table, key);
-	node = table->nodes[index];
+	_ht_migrate(table, HT_MIGRATION_STEP);
+
+	hash = _ht_key_hash(table, key);
+	chain = &table->nodes[_ht_bucket(hash, table->capacity)];
+	if (table->old_nodes) {
+		/* Not in the current array means it can only be in an old chain not yet moved. */
+		for (node = *chain; node && !_ht_equal(table, key, node->key); node = node->next);
+		if (!node) {
+			chain = &table->old_nodes[_ht_bucket(hash, table->old_capacity)];
+		}
+	}
+	node = *chain;
 
 	for (previous = NULL; node; previous = node, node = node->next) {
 		if (_ht_equal(table, key, node->key)) {
 			if (previous) {
 				previous->next = node->next;
 			} else {
-				table->nodes[index] = node->next;
+				*chain = node->next;
 			}
 
 			_ht_destroy_node(node);
@@ -259,6 +391,8 @@ int ht_clear(HashTable* table) {
 	ht_destroy(table);
 	_ht_allocate(table, HT_MINIMUM_CAPACITY);
 	table->size = 0;
+	table->old_capacity = 0;
+	table->old_next = 0;
 
 	return HT_SUCCESS;
 }
@@ -273,16 +407,16 @@ bool ht_is_initialized(HashTable* table) {
 	return table != NULL && table->nodes != NULL;
 }
 
-int ht_reserve(HashTable* table, size_t minimum_capacity) {
+int ht_reserve(HashTable* table, size_t expected_size) {
 	assert(ht_is_initialized(table));
 	if (!ht_is_initialized(table)) return HT_ERROR;
 
 	/*
-	 * We expect the "minimum capacity" to be in elements, not in array indices.
-	 * This encapsulates the design.
+	 * The table grows once it holds as many entries as it has chains, so
+	 * expected_size entries need one chain each, and one more to spare.
 	 */
-	if (minimum_capacity > table->threshold) {
-		return _ht_resize(table, minimum_capacity / HT_LOAD_FACTOR);
+	if (expected_size >= table->capacity) {
+		return _ht_resize(table, expected_size + 1);
 	}
 
 	return HT_SUCCESS;
@@ -307,39 +441,54 @@ int _ht_default_compare(void* first_key, void* second_key, size_t key_size) {
 }
 
 size_t _ht_default_hash(void* raw_key, size_t key_size) {
-	// djb2 string hashing algorithm
-	// sstp://www.cse.yorku.ca/~oz/hash.ssml
-	size_t byte;
-	size_t hash = 5381;
-	char* key = raw_key;
-
-	for (byte = 0; byte < key_size; ++byte) {
-		// (hash << 5) + hash = hash * 33
-		hash = ((hash << 5) + hash) ^ key[byte];
-	}
-
-	return hash;
+	return _ht_wyhash(raw_key, key_size);
 }
 
 size_t _ht_hash(const HashTable* table, void* key) {
+	return _ht_bucket(_ht_key_hash(table, key), table->capacity);
+}
+
+size_t _ht_bucket(size_t hash, size_t capacity) {
 #ifdef HT_USING_POWER_OF_TWO
-	return table->hash(key, table->key_size) & table->capacity;
+	return hash & (capacity - 1);
 #else
-	return table->hash(key, table->key_size) % table->capacity;
+	return hash % capacity;
 #endif
 }
 
+HTNode* _ht_find(const HashTable* table, void* key) {
+	HTNode* node;
+	size_t hash = _ht_key_hash(table, key);
+
+	for (node = table->nodes[_ht_bucket(hash, table->capacity)]; node; node = node->next) {
+		if (_ht_equal(table, key, node->key)) {
+			return node;
+		}
+	}
+	if (table->old_nodes) {
+		/* A moved chain is empty, so it needs no check against old_next. */
+		for (node = table->old_nodes[_ht_bucket(hash, table->old_capacity)]; node; node = node->next) {
+			if (_ht_equal(table, key, node->key)) {
+				return node;
+			}
+		}
+	}
+
+	return NULL;
+}
+
 bool _ht_equal(const HashTable* table, void* first_key, void* second_key) {
+	if (table->compare == _ht_default_compare) {
+		return _ht_keys_equal(first_key, second_key, table->key_size);
+	}
 	return table->compare(first_key, second_key, table->key_size) == 0;
 }
 
 bool _ht_should_grow(HashTable* table) {
-	assert(table->size <= table->capacity);
-	return table->size == table->capacity;
+	return table->size >= table->capacity;
 }
 
 bool _ht_should_shrink(HashTable* table) {
-	assert(table->size <= table->capacity);
 	return table->size == table->capacity * HT_SHRINK_THRESHOLD;
 }
 
@@ -386,10 +535,9 @@ int _ht_adjust_capacity(HashTable* table) {
 }
 
 int _ht_allocate(HashTable* table, size_t capacity) {
-	if ((table->nodes = malloc(capacity * sizeof(HTNode*))) == NULL) {
+	if ((table->nodes = calloc(capacity, sizeof(HTNode*))) == NULL) {
 		return HT_ERROR;
 	}
-	memset(table->nodes, 0, capacity * sizeof(HTNode*));
 
 	table->capacity = capacity;
 	table->threshold = capacity * HT_LOAD_FACTOR;
@@ -397,6 +545,14 @@ int _ht_allocate(HashTable* table, size_t capacity) {
 	return HT_SUCCESS;
 }
 
+/*
+ * Resizes without rehashing: the current array becomes the old one and a new
+ * array takes its place. Every later operation moves HT_MIGRATION_STEP old
+ * chains across, so no single call rehashes the whole table. Growth doubles
+ * the capacity once size reaches it, and moving the old chains takes a
+ * quarter as many operations as the inserts to the next growth, so a resize
+ * has finished before another starts. If one has not, it is finished first.
+ */
 int _ht_resize(HashTable* table, size_t new_capacity) {
 	HTNode** old;
 	size_t old_capacity;
@@ -410,27 +566,47 @@ int _ht_resize(HashTable* table, size_t new_capacity) {
 		}
 	}
 
+	if (table->size == 0 && table->old_nodes) {
+		/* Every old chain is empty, so there is nothing to move. */
+		free(table->old_nodes);
+		table->old_nodes = NULL;
+		table->old_capacity = 0;
+		table->old_next = 0;
+	}
+	_ht_migrate(table, SIZE_MAX);
+
 	old = table->nodes;
 	old_capacity = table->capacity;
 	if (_ht_allocate(table, new_capacity) == HT_ERROR) {
+		table->nodes = old;
+		table->capacity = old_capacity;
+		table->threshold = old_capacity * HT_LOAD_FACTOR;
 		return HT_ERROR;
 	}
 
-	_ht_rehash(table, old, old_capacity);
-
-	free(old);
+	if (table->size == 0) {
+		free(old);
+		return HT_SUCCESS;
+	}
+	table->old_nodes = old;
+	table->old_capacity = old_capacity;
+	table->old_next = 0;
 
 	return HT_SUCCESS;
 }
 
-void _ht_rehash(HashTable* table, HTNode** old, size_t old_capacity) {
+/* Moves up to chains old chains into the current array, freeing the old array once it is empty. */
+void _ht_migrate(HashTable* table, size_t chains) {
 	HTNode* node;
 	HTNode* next;
 	size_t new_index;
-	size_t chain;
 
-	for (chain = 0; chain < old_capacity; ++chain) {
-		for (node = old[chain]; node;) {
+	if (table->old_nodes == NULL) {
+		return;
+	}
+
+	for (; chains > 0 && table->old_next < table->old_capacity; --chains, ++table->old_next) {
+		for (node = table->old_nodes[table->old_next]; node;) {
 			next = node->next;
 
 			new_index = _ht_hash(table, node->key);
@@ -439,5 +615,13 @@ void _ht_rehash(HashTable* table, HTNode** old, size_t old_capacity) {
 
 			node = next;
 		}
+		table->old_nodes[table->old_next] = NULL;
 	}
-}
\ No newline at end of file
+
+	if (table->old_next == table->old_capacity) {
+		free(table->old_nodes);
+		table->old_nodes = NULL;
+		table->old_capacity = 0;
+		table->old_next = 0;
+	}
+}
@@ -15,6 +15,8 @@
 #define HT_MINIMUM_THRESHOLD (HT_MINIMUM_CAPACITY) * (HT_LOAD_FACTOR)
 
 #define HT_GROWTH_FACTOR 2
+/* Old chains moved to the new bucket array by each operation during a resize. */
+#define HT_MIGRATION_STEP 4
 #define HT_SHRINK_THRESHOLD (1 / 4)
 
 #define HT_ERROR -1
@@ -26,7 +28,7 @@
 #define HT_NOT_FOUND 0
 #define HT_FOUND 01
 
-#define HT_INITIALIZER {0, 0, 0, 0, 0, NULL, NULL, NULL};
+#define HT_INITIALIZER {0, 0, 0, 0, 0, NULL, NULL, NULL, NULL, 0, 0};
 
 typedef int (*comparison_t)(void*, void*, size_t);
 typedef size_t (*hash_t)(void*, size_t);
@@ -53,6 +55,15 @@ typedef struct HashTable {
 
 	HTNode** nodes;
 
+	/*
+	 * While a resize is under way, the bucket array being emptied into nodes.
+	 * Chains below old_next have been moved; the rest are still here and are
+	 * searched as well.
+	 */
+	HTNode** old_nodes;
+	size_t old_capacity;
+	size_t old_next;
+
 } HashTable;
 
 /****************** INTERFACE ******************/
@@ -85,7 +96,8 @@ int ht_clear(HashTable* table);
 int ht_is_empty(HashTable* table);
 bool ht_is_initialized(HashTable* table);
 
-int ht_reserve(HashTable* table, size_t minimum_capacity);
+/* Sizes the table to hold at least expected_size entries without growing. */
+int ht_reserve(HashTable* table, size_t expected_size);
 
 /****************** PRIVATE ******************/
 
@@ -96,6 +108,8 @@ size_t _ht_default_hash(void* key, size_t key_size);
 int _ht_default_compare(void* first_key, void* second_key, size_t key_size);
 
 size_t _ht_hash(const HashTable* table, void* key);
+size_t _ht_bucket(size_t hash, size_t capacity);
+HTNode* _ht_find(const HashTable* table, void* key);
 bool _ht_equal(const HashTable* table, void* first_key, void* second_key);
 
 bool _ht_should_grow(HashTable* table);
@@ -108,6 +122,6 @@ void _ht_destroy_node(HTNode* node);
 int _ht_adjust_capacity(HashTable* table);
 int _ht_allocate(HashTable* table, size_t capacity);
 int _ht_resize(HashTable* table, size_t new_capacity);
-void _ht_rehash(HashTable* table, HTNode** old, size_t old_capacity);
+void _ht_migrate(HashTable* table, size_t chains);
 
 #endif /* HASHTABLE_H */
\ No newline at end of file
@@ -0,0 +1,96 @@
+#include <stdlib.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "hint.h"
+#include "ai.h"
+
+/* Optimal moves from the position the last search started at; the current position is planOffset in. */
+static char *plan = NULL;
+static size_t planOffset = 0;
+/* A search has finished for the current line of play; a NULL plan then means no solution. */
+static bool planKnown = false;
+static bool requested = false;
+
+static pthread_t worker;
+static bool workerRunning = false;
+static atomic_bool workerDone;
+static atomic_bool workerCancel;
+/* Written by the worker before it sets workerDone. */
+static char *workerResult = NULL;
+
+static void *run_worker(void *arg) {
+	gate_t *position = (gate_t *)arg;
+	workerResult = find_hint(position, &workerCancel);
+	free_state(position, NULL);
+	atomic_store(&workerDone, true);
+	return NULL;
+}
+
+void hint_request(gate_t *gate) {
+	requested = true;
+	if (planKnown || workerRunning) {
+		return;
+	}
+
+	/* The display keeps moving pieces on its own map, so the worker gets a copy. */
+	gate_t position = *gate;
+	position.soln = NULL;
+	position = find_pieces(position);
+	gate_t *snapshot = duplicate_state(&position);
+	if (!snapshot) {
+		requested = false;
+		return;
+	}
+	workerResult = NULL;
+	atomic_store(&workerDone, false);
+	atomic_store(&workerCancel, false);
+	if (pthread_create(&worker, NULL, run_worker, snapshot) != 0) {
+		free_state(snapshot, NULL);
+		requested = false;
+		return;
+	}
+	workerRunning = true;
+}
+
+hint_status_t hint_poll(char *piece, char *direction) {
+	if (workerRunning && atomic_load(&workerDone)) {
+		pthread_join(worker, NULL);
+		workerRunning = false;
+		plan = workerResult;
+		planOffset = 0;
+		planKnown = true;
+		workerResult = NULL;
+	}
+	if (!requested) {
+		return HINT_IDLE;
+	}
+	if (!planKnown) {
+		return HINT_PENDING;
+	}
+	if (!plan || plan[planOffset] == '\0') {
+		return HINT_UNSOLVABLE;
+	}
+	*piece = plan[planOffset];
+	*direction = plan[planOffset + 1];
+	return HINT_READY;
+}
+
+void hint_moved(char piece, char direction) {
+	requested = false;
+	/* A suffix of an optimal plan is optimal from where it starts, so following it keeps it. */
+	if (planKnown && plan && plan[planOffset] == piece && plan[planOffset + 1] == direction) {
+		planOffset += 2;
+		return;
+	}
+	free(plan);
+	plan = NULL;
+	planKnown = false;
+	if (workerRunning) {
+		atomic_store(&workerCancel, true);
+		pthread_join(worker, NULL);
+		workerRunning = false;
+		free(workerResult);
+		workerResult = NULL;
+	}
+}
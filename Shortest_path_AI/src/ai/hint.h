@@ -0,0 +1,34 @@
+/*
+ * Hints for interactive play. A request snapshots the board and solves it
+ * with UCS on a worker thread, so the display keeps taking keys meanwhile.
+ * The optimal plan found is kept: while the player follows it, each later
+ * hint is the next move of the plan with no new search. Any other move
+ * discards the plan and cancels a search still running.
+*/
+#ifndef __HINT__
+#define __HINT__
+
+#include <stdbool.h>
+
+#include "gate.h"
+
+typedef enum hint_status {
+	/* No hint has been asked for since the last move. */
+	HINT_IDLE,
+	/* The worker is still searching. */
+	HINT_PENDING,
+	HINT_READY,
+	/* The position has no solution. */
+	HINT_UNSOLVABLE
+} hint_status_t;
+
+/* Asks for a hint for the current position; returns at once. */
+void hint_request(gate_t *gate);
+
+/* Collects a finished search. On HINT_READY, sets the suggested move. */
+hint_status_t hint_poll(char *piece, char *direction);
+
+/* Tells the hint worker the player made a move. */
+void hint_moved(char piece, char direction);
+
+#endif
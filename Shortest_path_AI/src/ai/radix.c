@@ -4,31 +4,73 @@
 #include <stdio.h>
 #include <assert.h>
 #include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #define INITIALCAPACITY 1024
 
+/*
+    The two children of a split are always stored next to each other as a
+    pair, the child on a 0 bit first, so a node holds only the index of its
+    first child. Each node holds a 32 bit pair index of its children (0 for
+    a leaf, since pair 0 holds only the root) and a byte of prefix length,
+    so the index covers every pair that an int node count can reach. One
+    child of every split keeps the bits that followed its parent's prefix,
+    so its prefix start is the parent's end and is not stored; the pair
+    records the start and side of the other child only.
+*/
+struct radixPair {
+    uint32_t childPair[2];
+    /* Prefix start of the child with new bits, shifted left once, ORed with its side. */
+    uint32_t fresh;
+    uint8_t numBits[2];
+};
+
 /* Packed radix tree. */
 struct radixTree {
     // Info to derive bits per element.
     int numPieces;
     int height;
     int width;
+    // Bits per piece, worked out once from the three above.
+    int atomSize;
 
-    // Structure of tree packed as struct of (bit) arrays.
+    // Structure of tree packed as an array of node pairs, node i in pair i / 2.
     int nodeCount;
     int nodeCapacity;
- 
-    int *prefixBitStartBytes;
-    
-    int *prefixBitsBytes;
+    struct radixPair *pairs;
+
     // Bits are stored in one contiguous bit array referred to by all nodes.
     int prefixBitsAllocated;
     int prefixBitsUsed;
     unsigned char *prefixBytes;
-    int *branchABytes;
-    int *branchBBytes;
+
+    // Set when pairs and prefixBytes point into a read-only file mapping.
+    void *mapping;
+    size_t mappingBytes;
 };
 
+/* Start of a radix tree file, followed by the pairs and then the prefix bytes. */
+struct radixFileHeader {
+    char magic[4];
+    uint32_t version;
+    /* Written as 0x01020304 to reject files from a machine of other byte order. */
+    uint32_t byteOrder;
+    int32_t numPieces;
+    int32_t height;
+    int32_t width;
+    /* Whether keys were packed canonically under the board's symmetry. */
+    int32_t symmetry;
+    int32_t nodeCount;
+    int32_t prefixBitsUsed;
+    /* Caller's fingerprint of the board the keys belong to, 0 inside a checkpoint. */
+    uint64_t board;
+};
+
+#define RADIX_FILE_MAGIC "GRDX"
+#define RADIX_BYTE_ORDER 0x01020304U
+
 // Helper structure.
 struct radixTreeNode;
 
@@ -36,8 +78,8 @@ struct radixTreeNode {
     int nodeIdx;
     int bitStart;
     int numBits;
+    /* Child followed on a 0 bit; the child on a 1 bit is branchA + 1. */
     int branchA;
-    int branchB;
 };
 
 /* Number of bits in a single character. */
@@ -67,13 +109,42 @@ int getBit(unsigned char *s, unsigned int bitIndex){
     return bitOnly;
 }
 
+/* Longest run of bits compared at once; any run fits in one 64 bit load. */
+#define MAX_RUN_BITS 56
+
+/* Reads bitCount (at most MAX_RUN_BITS) bits from bitIndex, the first as the highest. */
+static inline uint64_t getBits(const unsigned char *s, unsigned int bitIndex, int bitCount){
+    unsigned int byte = bitIndex / BITS_PER_BYTE;
+    int skip = bitIndex % BITS_PER_BYTE;
+    int byteCount = (skip + bitCount + (BITS_PER_BYTE - 1)) / BITS_PER_BYTE;
+    uint64_t bits = 0;
+    for(int k = 0; k < byteCount; k++) {
+        bits = (bits << BITS_PER_BYTE) | s[byte + k];
+    }
+    bits >>= byteCount * BITS_PER_BYTE - skip - bitCount;
+    return bits & ((((uint64_t) 1) << bitCount) - 1);
+}
+
+/*
+    Number of leading bits the key and a node's prefix share over the next
+    bitCount bits, bitCount if they all match.
+*/
+static inline int matchingBits(const unsigned char *prefixBytes, int prefixStart, const unsigned char *bitPacked,
+    int keyStart, int bitCount){
+    uint64_t diff = getBits(prefixBytes, prefixStart, bitCount) ^ getBits(bitPacked, keyStart, bitCount);
+    if(diff == 0) {
+        return bitCount;
+    }
+    return bitCount - 64 + __builtin_clzll(diff);
+}
+
 int queryRadixMemoryUsage(struct radixTree *tree) {
     int memoryUsage = 0;
     /* 
         Data for each node:
-        prefixBitStartByte, prefixBits, branchA, branchB
+        one word holding prefixBits and branchA, plus one prefixBitStart per pair
      */
-    memoryUsage += tree->nodeCount * (sizeof(int) * (1 + 1 + 1 + 1));
+    memoryUsage += (tree->nodeCount / 2) * sizeof(struct radixPair);
     /*
         Data used in bits - a bit spilling over one byte takes one more byte.
     */
@@ -94,19 +165,20 @@ struct radixTree *getNewRadixTree(int numPieces, int height, int width) {
     rt->numPieces = numPieces;
     rt->height = height;
     rt->width = width;
+    rt->atomSize = calcBits(numPieces) + calcBits(height) + calcBits(width);
     
     rt->nodeCount = 0;
     rt->nodeCapacity = 0;
 
-    rt->prefixBitStartBytes = NULL;
-    rt->prefixBitsBytes = NULL;
+    rt->pairs = NULL;
     rt->prefixBytes = NULL;
-    rt->branchABytes = NULL;
-    rt->branchBBytes = NULL;
 
     rt->prefixBitsAllocated = 0;
     rt->prefixBitsUsed = 0;
 
+    rt->mapping = NULL;
+    rt->mappingBytes = 0;
+
     return rt;
 }
 
@@ -120,50 +192,57 @@ int calcBits(int x) {
     return bitsNeeded;
 }
 
-struct radixTreeNode getTreeNode(struct radixTree *tree, int idx);
+/* Reads node idx; parentEnd is the prefix end of its parent, 0 for the root. */
+struct radixTreeNode getTreeNode(struct radixTree *tree, int idx, int parentEnd);
 
-struct radixTreeNode getTreeNode(struct radixTree *tree, int idx){
+struct radixTreeNode getTreeNode(struct radixTree *tree, int idx, int parentEnd){
     struct radixTreeNode rt;
+    struct radixPair *pair = &tree->pairs[idx / 2];
     
     rt.nodeIdx = idx;
-    rt.bitStart = tree->prefixBitStartBytes[idx];
-    rt.numBits = tree->prefixBitsBytes[idx];
-    rt.branchA = tree->branchABytes[idx];
-    rt.branchB = tree->branchBBytes[idx];
+    rt.numBits = (int) pair->numBits[idx % 2];
+    rt.branchA = (int) pair->childPair[idx % 2] * 2;
+    if(rt.branchA == 0) {
+        rt.branchA = NOCHILD;
+    }
+    if((int) (pair->fresh & 1) == idx % 2) {
+        rt.bitStart = (int) (pair->fresh >> 1);
+    } else {
+        rt.bitStart = parentEnd;
+    }
 
     return rt;
 }
 
-void storeNode(struct radixTree *tree, struct radixTreeNode *node);
+/* Stores the node; fresh is set for a node whose prefix bits were newly written. */
+void storeNode(struct radixTree *tree, struct radixTreeNode *node, int fresh);
 
-void storeNode(struct radixTree *tree, struct radixTreeNode *node){
+void storeNode(struct radixTree *tree, struct radixTreeNode *node, int fresh){
     if(node->nodeIdx >= tree->nodeCount) {
         while(node->nodeIdx + 1 > tree->nodeCapacity){
             /* Resize needed. */
             tree->nodeCapacity *= 2;
-            tree->prefixBitStartBytes = (int *) realloc(tree->prefixBitStartBytes, tree->nodeCapacity * sizeof(int));
-            assert(tree->prefixBitStartBytes);
-            tree->prefixBitsBytes = (int *) realloc(tree->prefixBitsBytes, tree->nodeCapacity * sizeof(int));
-            assert(tree->prefixBitsBytes);
-            tree->branchABytes = (int *) realloc(tree->branchABytes, tree->nodeCapacity * sizeof(int));
-            assert(tree->branchABytes);
-            tree->branchBBytes = (int *) realloc(tree->branchBBytes, tree->nodeCapacity * sizeof(int));
-            assert(tree->branchBBytes);
+            tree->pairs = (struct radixPair *) realloc(tree->pairs, tree->nodeCapacity / 2 * sizeof(struct radixPair));
+            assert(tree->pairs);
         }
-        tree->nodeCount = node->nodeIdx + 1;
+        /* Pairs are claimed whole. */
+        tree->nodeCount = (node->nodeIdx / 2 + 1) * 2;
+    }
+    uint32_t childPair = node->branchA == NOCHILD ? 0 : (uint32_t) (node->branchA / 2);
+    /* A prefix is never longer than a key, so its length fits in a byte. */
+    assert(node->numBits <= UINT8_MAX);
+    struct radixPair *pair = &tree->pairs[node->nodeIdx / 2];
+    pair->childPair[node->nodeIdx % 2] = childPair;
+    pair->numBits[node->nodeIdx % 2] = (uint8_t) node->numBits;
+    if(fresh) {
+        assert(node->bitStart >= 0);
+        pair->fresh = (((uint32_t) node->bitStart) << 1) | (uint32_t) (node->nodeIdx % 2);
     }
-    tree->prefixBitStartBytes[node->nodeIdx] = node->bitStart;
-    tree->prefixBitsBytes[node->nodeIdx] = node->numBits;
-    tree->branchABytes[node->nodeIdx] = node->branchA;
-    tree->branchBBytes[node->nodeIdx] = node->branchB;
 }
 
 /* Checks if the state is present in the radix tree. */
 int checkPresent(struct radixTree *tree, unsigned char *bitPacked, int atomCount) {
-    int pBits = calcBits(tree->numPieces);
-    int hBits = calcBits(tree->height);
-    int wBits = calcBits(tree->width);
-    int atomSize = pBits + hBits + wBits;
+    int atomSize = tree->atomSize;
 
     /* Full check, so bits contain location of all pieces. */
     int bitCount = atomSize * atomCount;
@@ -173,26 +252,30 @@ int checkPresent(struct radixTree *tree, unsigned char *bitPacked, int atomCount
     }
 
     /* Get root. */
-    struct radixTreeNode node = getTreeNode(tree, 0);
+    struct radixTreeNode node = getTreeNode(tree, 0, 0);
 
-    /* Search */
+    /* Search, comparing up to MAX_RUN_BITS bits of a prefix at a time. */
     int progress = 0;
-    for(int i = 0; i < bitCount; i++) {
+    int i = 0;
+    while(i < bitCount) {
         if(progress == node.numBits){
             /* Branch. */
-            if(getBit(bitPacked, i) == 0) {
-                node = getTreeNode(tree, node.branchA);
-                progress = 0;
-            } else {
-                node = getTreeNode(tree, node.branchB);
-                progress = 0;
-            }
+            node = getTreeNode(tree, node.branchA + getBit(bitPacked, i), node.bitStart + node.numBits);
+            progress = 0;
+        }
+        int run = node.numBits - progress;
+        if(run > bitCount - i) {
+            run = bitCount - i;
         }
-        if(getBit(tree->prefixBytes, node.bitStart + progress) != getBit(bitPacked, i)){
+        if(run > MAX_RUN_BITS) {
+            run = MAX_RUN_BITS;
+        }
+        if(matchingBits(tree->prefixBytes, node.bitStart + progress, bitPacked, i, run) != run){
             /* Mismatch, not in tree. */
             return NOTPRESENT;
         }
-        progress++;
+        i += run;
+        progress += run;
     }
     /* Got through whole bitPacked representation. Should be true since we assume bitPacked items are always inserted. */
     assert(progress == node.numBits);
@@ -235,10 +318,7 @@ void writeNewBits(struct radixTree *tree, unsigned char *bitPacked, int startBit
 
 /* Inserts the state into the radix tree. */
 void insertRadixTree(struct radixTree *tree, unsigned char *bitPacked, int atomCount) {
-    int pBits = calcBits(tree->numPieces);
-    int hBits = calcBits(tree->height);
-    int wBits = calcBits(tree->width);
-    int atomSize = pBits + hBits + wBits;
+    int atomSize = tree->atomSize;
 
     /* Full check, so bits contain location of all pieces. */
     int bitCount = atomSize * atomCount;
@@ -247,24 +327,23 @@ void insertRadixTree(struct radixTree *tree, unsigned char *bitPacked, int atomC
     if(checkPresent(tree, bitPacked, atomCount)){
         return;
     }
+    /* Mapped trees are read-only. */
+    assert(! tree->mapping);
 
     /* Empty tree. */
     if(tree->nodeCapacity == 0) {
         tree->nodeCapacity = INITIALCAPACITY;
         
-        tree->prefixBitStartBytes = (int *) malloc(sizeof(int) * INITIALCAPACITY);
-        assert(tree->prefixBitStartBytes);
-        tree->prefixBitsBytes = (int *) malloc(sizeof(int) * INITIALCAPACITY);
-        assert(tree->prefixBitsBytes);
-        tree->branchABytes = (int *) malloc(sizeof(int) * INITIALCAPACITY);
-        assert(tree->branchABytes);
-        tree->branchBBytes = (int *) malloc(sizeof(int) * INITIALCAPACITY);
-        assert(tree->branchBBytes);
-
-        (tree->prefixBitStartBytes)[0] = 0;
-        (tree->branchABytes)[0] = NOCHILD;
-        (tree->branchBBytes)[0] = NOCHILD;
-        (tree->prefixBitsBytes)[0] = bitCount;
+        tree->pairs = (struct radixPair *) malloc(sizeof(struct radixPair) * INITIALCAPACITY / 2);
+        assert(tree->pairs);
+
+        /* The root occupies pair 0 alone. */
+        struct radixTreeNode root;
+        root.nodeIdx = 0;
+        root.bitStart = 0;
+        root.numBits = bitCount;
+        root.branchA = NOCHILD;
+        storeNode(tree, &root, 1);
         
         // Start with INITIALCAPACITY full length prefixes of bitCount length.
         tree->prefixBitsAllocated = ((((bitCount * INITIALCAPACITY + (BITS_PER_BYTE - 1)))/BITS_PER_BYTE)) * sizeof(unsigned char) * BITS_PER_BYTE;
@@ -272,187 +351,299 @@ void insertRadixTree(struct radixTree *tree, unsigned char *bitPacked, int atomC
         assert(tree->prefixBytes);
 
         writeNewBits(tree, bitPacked, 0, bitCount);
-
-        (tree->nodeCount)++;
         return;
     }
 
     /* Find mismatch */
     /* Get root. */
-    struct radixTreeNode node = getTreeNode(tree, 0);
+    struct radixTreeNode node = getTreeNode(tree, 0, 0);
 
     /* Search */
     int progress = 0;
-    for(int i = 0; i < bitCount; i++) {
+    int i = 0;
+    while(i < bitCount) {
         if(progress == node.numBits){
             /* Branch. */
-            if(getBit(bitPacked, i) == 0) {
-                node = getTreeNode(tree, node.branchA);
-                progress = 0;
-            } else {
-                node = getTreeNode(tree, node.branchB);
-                progress = 0;
-            }
+            node = getTreeNode(tree, node.branchA + getBit(bitPacked, i), node.bitStart + node.numBits);
+            progress = 0;
+        }
+        int run = node.numBits - progress;
+        if(run > bitCount - i) {
+            run = bitCount - i;
+        }
+        if(run > MAX_RUN_BITS) {
+            run = MAX_RUN_BITS;
         }
-        if(getBit(tree->prefixBytes, node.bitStart + progress) != getBit(bitPacked, i)){
-            /* Mismatch, not in tree. Add to tree. */
+        int matched = matchingBits(tree->prefixBytes, node.bitStart + progress, bitPacked, i, run);
+        i += matched;
+        progress += matched;
+        if(matched < run){
+            /* Mismatch at bit i, not in tree. Add to tree. */
             /* Part 0: Root node changes. */
             struct radixTreeNode newRoot;
             newRoot = node;
             newRoot.numBits = progress;
-            // newRoot.branchA 
-            // newRoot.branchB
+            /* Both children are stored as a pair, the child on a 0 bit first. */
+            int newBit = getBit(bitPacked, i);
+            newRoot.branchA = tree->nodeCount;
             /* Part 1: Node generated from bit packed insertion. */
             struct radixTreeNode newNode;
-            newNode.nodeIdx = tree->nodeCount + 1;
+            newNode.nodeIdx = newRoot.branchA + newBit;
             newNode.bitStart = tree->prefixBitsUsed;
             int remainingBits = bitCount - i;
             newNode.numBits = remainingBits;
             newNode.branchA = NOCHILD;
-            newNode.branchB = NOCHILD;
             /* Part 2: Node generated from existing tree. */
             struct radixTreeNode existingNode;
-            existingNode.nodeIdx = tree->nodeCount;
+            existingNode.nodeIdx = newRoot.branchA + (1 - newBit);
             existingNode.bitStart = node.bitStart + progress;
             int existingRemaining = node.numBits - progress;
             existingNode.numBits = existingRemaining;
             /* Inherits existing children. */
             existingNode.branchA = node.branchA;
-            existingNode.branchB = node.branchB;
-            if(getBit(bitPacked, i) == 0) {
-                newRoot.branchA = newNode.nodeIdx;
-                newRoot.branchB = existingNode.nodeIdx;
-            } else {
-                newRoot.branchA = existingNode.nodeIdx;
-                newRoot.branchB = newNode.nodeIdx;
-            }
             /* Store prefix data. */
             writeNewBits(tree, bitPacked, i, remainingBits);
-            /* Store nodes. */
-            storeNode(tree, &existingNode);
-            storeNode(tree, &newNode);
-            storeNode(tree, &newRoot);
+            /* Store nodes. The existing node's prefix start follows from newRoot's end. */
+            storeNode(tree, &newNode, 1);
+            storeNode(tree, &existingNode, 0);
+            storeNode(tree, &newRoot, 0);
             return;
         }
-        progress++;
     }
 }
 
-void writeNewBitsnCr(unsigned char *destBits, int destFilledBits, unsigned char *bitPacked, int startBit, int bitCount);
+/* Reads the atom at atomIndex of bitPacked, the first bit highest. */
+static inline uint32_t readAtom(const unsigned char *bitPacked, int atomIndex, int atomSize){
+    int start = atomIndex * atomSize;
+    int skip = start % BITS_PER_BYTE;
+    int byteCount = (skip + atomSize + (BITS_PER_BYTE - 1)) / BITS_PER_BYTE;
+    uint32_t atom = 0;
+    for(int k = 0; k < byteCount; k++) {
+        atom = (atom << BITS_PER_BYTE) | bitPacked[start / BITS_PER_BYTE + k];
+    }
+    return (atom >> (byteCount * BITS_PER_BYTE - skip - atomSize)) & ((((uint32_t) 1) << atomSize) - 1);
+}
 
-void writeNewBitsnCr(unsigned char *destBits, int destFilledBits, unsigned char *bitPacked, int startBit, int bitCount){
-    for(int i = 0; i < bitCount; i++) {
-        if(getBit(bitPacked, startBit + i) == 0){
-            bitOff(destBits, destFilledBits + i);
-        } else {
-            bitOn(destBits, destFilledBits + i);
-        }
+/* ORs an atom into the slot at atomIndex of dest, whose bits there must be clear. */
+static inline void writeAtom(unsigned char *dest, int atomIndex, int atomSize, uint32_t atom){
+    int start = atomIndex * atomSize;
+    int skip = start % BITS_PER_BYTE;
+    int byteCount = (skip + atomSize + (BITS_PER_BYTE - 1)) / BITS_PER_BYTE;
+    atom <<= byteCount * BITS_PER_BYTE - skip - atomSize;
+    for(int k = 0; k < byteCount; k++) {
+        dest[start / BITS_PER_BYTE + k] |= (unsigned char) (atom >> (BITS_PER_BYTE * (byteCount - 1 - k)));
     }
 }
 
-/* Checks if all state sections of length s are in the radix tree. */
-int checkPresentnCr(struct radixTree *tree, unsigned char *bitPacked, int size) {
-    int pBits = calcBits(tree->numPieces);
-    int hBits = calcBits(tree->height);
-    int wBits = calcBits(tree->width);
-    int atomSize = pBits + hBits + wBits;
-
-    /* Size * atoms, so bits contain location of size pieces. */
-    int bitCount = atomSize * size;
-
-    unsigned char *partialBitPack = (unsigned char *) calloc((bitCount + (BITS_PER_BYTE - 1) / BITS_PER_BYTE), sizeof(unsigned char));
-    assert(partialBitPack);
-
-    /* Stack helper to perform power set. */
-    int packPartial(int remainingSize, int startingAtom) {
-        if(remainingSize <= 0) {
-            if(checkPresent(tree, partialBitPack, size) == NOTPRESENT) {
-                /* Any section being not present is sufficient to determine non-presence. */
-                return NOTPRESENT;
-            }
-            return PRESENT;
-        }
-        for(int i = startingAtom; i <= (tree->numPieces - remainingSize); i++){
-            writeNewBitsnCr(partialBitPack, atomSize * (size - remainingSize), bitPacked, atomSize * i, atomSize);
-            int ppr = packPartial(remainingSize - 1, i + 1);
-            if (ppr == NOTPRESENT){
-                return NOTPRESENT;
-            }
-        }
-        /* Default behaviour - return present */
-        return PRESENT;
+/* Clears the subset from slot first on and packs the atoms its indices now name. */
+static void packSubsetFrom(struct atomSubsets *subsets, int first){
+    int startBit = first * subsets->atomSize;
+    int byte = startBit / BITS_PER_BYTE;
+    int usedBytes = (subsets->size * subsets->atomSize + (BITS_PER_BYTE - 1)) / BITS_PER_BYTE;
+    if(startBit % BITS_PER_BYTE != 0) {
+        subsets->buffer[byte] &= (unsigned char) (0xFF << (BITS_PER_BYTE - startBit % BITS_PER_BYTE));
+        byte++;
+    }
+    if(byte < usedBytes) {
+        memset(subsets->buffer + byte, 0, usedBytes - byte);
+    }
+    for(int k = first; k < subsets->size; k++) {
+        writeAtom(subsets->buffer, k, subsets->atomSize,
+            readAtom(subsets->bitPacked, subsets->indices[k], subsets->atomSize));
+    }
+}
+
+void startAtomSubsets(struct atomSubsets *subsets, const unsigned char *bitPacked, int atomCount, int size,
+    int atomSize, unsigned char *buffer){
+    assert(size >= 1 && size <= atomCount && atomCount <= RADIX_MAX_ATOMS);
+    assert(atomSize <= RADIX_MAX_ATOM_BITS);
+    subsets->bitPacked = bitPacked;
+    subsets->atomCount = atomCount;
+    subsets->size = size;
+    subsets->atomSize = atomSize;
+    subsets->buffer = buffer;
+    for(int k = 0; k < size; k++) {
+        subsets->indices[k] = k;
+    }
+    packSubsetFrom(subsets, 0);
+}
+
+bool nextAtomSubset(struct atomSubsets *subsets){
+    int size = subsets->size;
+    /* The last index that can still move up; every index after it restarts just above it. */
+    int k = size - 1;
+    while(k >= 0 && subsets->indices[k] == subsets->atomCount - size + k) {
+        k--;
     }
+    if(k < 0) {
+        return false;
+    }
+    subsets->indices[k]++;
+    for(int j = k + 1; j < size; j++) {
+        subsets->indices[j] = subsets->indices[j - 1] + 1;
+    }
+    packSubsetFrom(subsets, k);
+    return true;
+}
 
-    /* Start from each location */
-    for(int i = 0; i <= (tree->numPieces - size); i++){
-        writeNewBitsnCr(partialBitPack, 0, bitPacked, atomSize * i, atomSize);
-        int ppr = packPartial(size - 1, i + 1);
-        if(ppr == NOTPRESENT) {
-            free(partialBitPack);
+/* Checks if all state sections of length s are in the radix tree. */
+int checkPresentnCr(struct radixTree *tree, const unsigned char *bitPacked, int size) {
+    unsigned char partialBitPack[RADIX_MAX_SUBSET_BYTES];
+    struct atomSubsets subsets;
+    startAtomSubsets(&subsets, bitPacked, tree->numPieces, size, tree->atomSize, partialBitPack);
+    do {
+        if(checkPresent(tree, partialBitPack, size) == NOTPRESENT) {
+            /* Any section being not present is sufficient to determine non-presence. */
             return NOTPRESENT;
         }
-    }
-    assert((tree->numPieces - size) >= 0);
-    free(partialBitPack);
+    } while(nextAtomSubset(&subsets));
     /* No missing atom combinations found. */
     return PRESENT;
 }
 
 /* Inserts sections of appropriate length */
-void insertRadixTreenCr(struct radixTree *tree, unsigned char *bitPacked, int size) {
-    int pBits = calcBits(tree->numPieces);
-    int hBits = calcBits(tree->height);
-    int wBits = calcBits(tree->width);
-    int atomSize = pBits + hBits + wBits;
-
-    /* Size * atoms, so bits contain location of size pieces. */
-    int bitCount = atomSize * size;
-
-    unsigned char *partialBitPack = (unsigned char *) calloc((bitCount + (BITS_PER_BYTE - 1) / BITS_PER_BYTE), sizeof(unsigned char));
-    assert(partialBitPack);
-
-    /* Stack helper to perform power set. */
-    void packPartial(int remainingSize, int startingAtom) {
-        if(remainingSize <= 0) {
-            if(checkPresent(tree, partialBitPack, size) == NOTPRESENT) {
-                /* New value. */
-                insertRadixTree(tree, partialBitPack, size);
-            }
-            return;
-        }
-        for(int i = startingAtom; i <= (tree->numPieces - remainingSize); i++){
-            writeNewBitsnCr(partialBitPack, atomSize * (size - remainingSize), bitPacked, atomSize * i, atomSize);
-            packPartial(remainingSize - 1, i + 1);
-        }
+void insertRadixTreenCr(struct radixTree *tree, const unsigned char *bitPacked, int size) {
+    unsigned char partialBitPack[RADIX_MAX_SUBSET_BYTES];
+    struct atomSubsets subsets;
+    startAtomSubsets(&subsets, bitPacked, tree->numPieces, size, tree->atomSize, partialBitPack);
+    do {
+        /* insertRadixTree skips sections already present. */
+        insertRadixTree(tree, partialBitPack, size);
+    } while(nextAtomSubset(&subsets));
+}
+
+static bool writeTree(struct radixTree *tree, FILE *file, uint64_t board, bool symmetry) {
+    struct radixFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, RADIX_FILE_MAGIC, sizeof(header.magic));
+    header.version = RADIX_FILE_VERSION;
+    header.byteOrder = RADIX_BYTE_ORDER;
+    header.numPieces = tree->numPieces;
+    header.height = tree->height;
+    header.width = tree->width;
+    header.symmetry = symmetry;
+    header.nodeCount = tree->nodeCount;
+    header.prefixBitsUsed = tree->prefixBitsUsed;
+    header.board = board;
+
+    size_t pairCount = tree->nodeCount / 2;
+    size_t prefixByteCount = (tree->prefixBitsUsed + (BITS_PER_BYTE - 1)) / BITS_PER_BYTE;
+    return fwrite(&header, sizeof(header), 1, file) == 1
+        && fwrite(tree->pairs, sizeof(struct radixPair), pairCount, file) == pairCount
+        && fwrite(tree->prefixBytes, sizeof(unsigned char), prefixByteCount, file) == prefixByteCount;
+}
+
+bool writeRadixTree(struct radixTree *tree, FILE *file) {
+    return writeTree(tree, file, 0, false);
+}
+
+bool saveRadixTree(struct radixTree *tree, const char *path, uint64_t board, bool symmetry) {
+    FILE *file = fopen(path, "wb");
+    if(! file) {
+        return false;
+    }
+    bool ok = writeTree(tree, file, board, symmetry);
+    if(fclose(file) != 0) {
+        ok = false;
     }
+    return ok;
+}
+
+static bool validHeader(const struct radixFileHeader *header, int numPieces, int height, int width) {
+    return memcmp(header->magic, RADIX_FILE_MAGIC, sizeof(header->magic)) == 0
+        && header->version == RADIX_FILE_VERSION && header->byteOrder == RADIX_BYTE_ORDER
+        && header->numPieces == numPieces && header->height == height && header->width == width
+        && header->nodeCount >= 0 && header->nodeCount % 2 == 0 && header->prefixBitsUsed >= 0;
+}
+
+struct radixTree *readRadixTree(FILE *file, int numPieces, int height, int width) {
+    struct radixFileHeader header;
+    if(fread(&header, sizeof(header), 1, file) != 1 || ! validHeader(&header, numPieces, height, width)) {
+        return NULL;
+    }
+    struct radixTree *tree = getNewRadixTree(numPieces, height, width);
+    if(header.nodeCount == 0) {
+        return tree;
+    }
+
+    /* Leave room to grow as insertRadixTree would have. */
+    tree->nodeCapacity = INITIALCAPACITY;
+    while(tree->nodeCapacity < header.nodeCount) {
+        tree->nodeCapacity *= 2;
+    }
+    tree->pairs = (struct radixPair *) malloc(tree->nodeCapacity / 2 * sizeof(struct radixPair));
+    assert(tree->pairs);
+    size_t prefixByteCount = ((size_t) header.prefixBitsUsed + (BITS_PER_BYTE - 1)) / BITS_PER_BYTE;
+    tree->prefixBitsAllocated = (int) prefixByteCount * BITS_PER_BYTE;
+    tree->prefixBytes = (unsigned char *) calloc(prefixByteCount, sizeof(unsigned char));
+    assert(tree->prefixBytes);
+    tree->nodeCount = header.nodeCount;
+    tree->prefixBitsUsed = header.prefixBitsUsed;
+
+    size_t pairCount = header.nodeCount / 2;
+    if(fread(tree->pairs, sizeof(struct radixPair), pairCount, file) != pairCount
+        || fread(tree->prefixBytes, sizeof(unsigned char), prefixByteCount, file) != prefixByteCount) {
+        freeRadixTree(tree);
+        return NULL;
+    }
+    return tree;
+}
 
-    /* Start from each location */
-    for(int i = 0; i <= (tree->numPieces - size); i++){
-        writeNewBitsnCr(partialBitPack, 0, bitPacked, atomSize * i, atomSize);
-        packPartial(size - 1, i + 1);
+struct radixTree *loadRadixTree(const char *path, int numPieces, int height, int width,
+    uint64_t board, bool symmetry) {
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) {
+        return NULL;
     }
-    assert((tree->numPieces - size) >= 0);
-    free(partialBitPack);
+    struct stat info;
+    if(fstat(fd, &info) != 0 || (size_t) info.st_size < sizeof(struct radixFileHeader)) {
+        close(fd);
+        return NULL;
+    }
+    size_t length = (size_t) info.st_size;
+    void *mapping = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED) {
+        return NULL;
+    }
+
+    const struct radixFileHeader *header = (const struct radixFileHeader *) mapping;
+    size_t pairBytes = (size_t) (header->nodeCount / 2) * sizeof(struct radixPair);
+    size_t prefixByteCount = ((size_t) header->prefixBitsUsed + (BITS_PER_BYTE - 1)) / BITS_PER_BYTE;
+    if(! validHeader(header, numPieces, height, width)
+        || header->board != board || header->symmetry != (int32_t) symmetry
+        || length < sizeof(struct radixFileHeader) + pairBytes + prefixByteCount) {
+        munmap(mapping, length);
+        return NULL;
+    }
+
+    struct radixTree *tree = getNewRadixTree(numPieces, height, width);
+    unsigned char *base = (unsigned char *) mapping;
+    tree->nodeCount = header->nodeCount;
+    tree->nodeCapacity = header->nodeCount;
+    tree->pairs = (struct radixPair *) (base + sizeof(struct radixFileHeader));
+    tree->prefixBitsUsed = header->prefixBitsUsed;
+    tree->prefixBitsAllocated = header->prefixBitsUsed;
+    tree->prefixBytes = base + sizeof(struct radixFileHeader) + pairBytes;
+    tree->mapping = mapping;
+    tree->mappingBytes = length;
+    return tree;
 }
 
 void freeRadixTree(struct radixTree *tree) {
     if(! tree) {
         return;
     }
+    if(tree->mapping) {
+        munmap(tree->mapping, tree->mappingBytes);
+        free(tree);
+        return;
+    }
     if(tree->prefixBytes) {
         free(tree->prefixBytes);
     }
-    if(tree->prefixBitsBytes) {
-        free(tree->prefixBitsBytes);
-    }
-    if(tree->prefixBitStartBytes) {
-        free(tree->prefixBitStartBytes);
-    }
-    if(tree->branchABytes) {
-        free(tree->branchABytes);
-    }
-    if(tree->branchBBytes) {
-        free(tree->branchBBytes);
+    if(tree->pairs) {
+        free(tree->pairs);
     }
     free(tree);
 }
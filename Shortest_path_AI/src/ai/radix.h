@@ -13,8 +13,13 @@
 #define NOCHILD (-1)
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
 #include <unistd.h>
 
+/* Version written to and required of radix tree files. */
+#define RADIX_FILE_VERSION (3)
+
 struct radixTree;
 
 /* Return memory used in radix tree. */
@@ -47,11 +52,71 @@ int checkPresent(struct radixTree *tree, unsigned char *bitPacked, int atomCount
 /* Inserts the state into the radix tree. */
 void insertRadixTree(struct radixTree *tree, unsigned char *bitPacked, int atomCount);
 
+/* Most atoms (pieces) in a key, and most bits in an atom, for the subset helpers. */
+#define RADIX_MAX_ATOMS 16
+#define RADIX_MAX_ATOM_BITS 24
+#define RADIX_MAX_SUBSET_BYTES ((RADIX_MAX_ATOMS * RADIX_MAX_ATOM_BITS + 7) / 8)
+
+/*
+    Walks the subsets of size atoms of a packed key in lexicographic order of
+    atom index, keeping the current subset packed in buffer (at least
+    RADIX_MAX_SUBSET_BYTES, or enough for size atoms). Each step repacks only
+    the atoms from the first index that changed; nothing is allocated.
+*/
+struct atomSubsets {
+    const unsigned char *bitPacked;
+    int atomCount;
+    int size;
+    int atomSize;
+    int indices[RADIX_MAX_ATOMS];
+    unsigned char *buffer;
+};
+
+/* Packs the first subset, atoms 0 to size - 1. */
+void startAtomSubsets(struct atomSubsets *subsets, const unsigned char *bitPacked, int atomCount, int size,
+    int atomSize, unsigned char *buffer);
+
+/* Packs the next subset, returning false once every subset has been visited. */
+bool nextAtomSubset(struct atomSubsets *subsets);
+
 /* Checks if all state sections of length s are in the radix tree. */
-int checkPresentnCr(struct radixTree *tree, unsigned char *bitPacked, int size);
+int checkPresentnCr(struct radixTree *tree, const unsigned char *bitPacked, int size);
 
 /* Inserts all sections of appropriate length s */
-void insertRadixTreenCr(struct radixTree *tree, unsigned char *bitPacked, int size);
+void insertRadixTreenCr(struct radixTree *tree, const unsigned char *bitPacked, int size);
+
+/*
+	Writes the tree to path as a versioned file in native byte order: a fixed
+	header, then the node records and prefix bits exactly as held in memory.
+	The header records board, the caller's fingerprint of the board the keys
+	belong to, and whether they were packed under its symmetry. Returns false
+	on an I/O error.
+*/
+bool saveRadixTree(struct radixTree *tree, const char *path, uint64_t board, bool symmetry);
+
+/*
+	Writes the tree in the saveRadixTree format at the current position of
+	file, with no board fingerprint: the file it is embedded in identifies
+	the board.
+*/
+bool writeRadixTree(struct radixTree *tree, FILE *file);
+
+/*
+	Reads a tree written by writeRadixTree from the current position of file
+	into ordinary memory, so it can be inserted into. Returns NULL if it is of
+	another version, was built for different piece count or board dimensions,
+	or on an I/O error.
+*/
+struct radixTree *readRadixTree(FILE *file, int numPieces, int height, int width);
+
+/*
+	Maps a tree written by saveRadixTree read-only, without copying or
+	parsing it. Returns NULL if the file cannot be mapped, is of another
+	version, or was built for different piece count, board dimensions, board
+	fingerprint or symmetry. The tree may be queried but not inserted into.
+*/
+struct radixTree *loadRadixTree(const char *path, int numPieces, int height, int width,
+	uint64_t board, bool symmetry);
 
 /* Free radix tree */
 void freeRadixTree(struct radixTree *tree);
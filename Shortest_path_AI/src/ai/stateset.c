@@ -0,0 +1,443 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "stateset.h"
+
+#define STATE_SET_INITIAL_CAPACITY 1024
+
+/* Slots probed together in a swiss set, and the control byte of an empty slot. */
+#define SWISS_GROUP 16
+#define SWISS_EMPTY 0x80
+
+typedef struct state_set_header {
+	int32_t kind;
+	int32_t keyBytes;
+	int64_t count;
+} state_set_header_t;
+
+static inline uint64_t mix(uint64_t h) {
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+/* Keys are copied into zeroed words in memory order; only equality and the hash depend on them. */
+static inline void load_words(const state_set_t *set, const unsigned char *key, uint64_t *words) {
+	words[0] = 0;
+	words[1] = 0;
+	memcpy(words, key, set->keyBytes);
+}
+
+static inline uint64_t hash_words(const uint64_t *words) {
+	return mix(words[0] ^ (words[1] * 0x9e3779b97f4a7c15ULL));
+}
+
+static inline uint64_t hash_bytes(const unsigned char *key, int length) {
+	uint64_t h = 0x9e3779b97f4a7c15ULL ^ (uint64_t)length;
+	int i = 0;
+	for (; i + 8 <= length; i += 8) {
+		uint64_t word;
+		memcpy(&word, key + i, sizeof(word));
+		h = (h ^ word) * 0xff51afd7ed558ccdULL;
+		h ^= h >> 32;
+	}
+	if (i < length) {
+		uint64_t word = 0;
+		memcpy(&word, key + i, length - i);
+		h = (h ^ word) * 0xff51afd7ed558ccdULL;
+	}
+	return mix(h);
+}
+
+static bool words_empty(const state_set_t *set, const uint64_t *slot) {
+	return slot[0] == 0 && (set->words == 1 || slot[1] == 0);
+}
+
+/* Slot holding words, or the empty slot that ends its probe sequence. */
+static inline size_t words_find(const state_set_t *set, const uint64_t *words) {
+	size_t mask = set->capacity - 1;
+	size_t index = hash_words(words) & mask;
+	if (set->words == 1) {
+		while (set->slots[index] != 0 && set->slots[index] != words[0]) {
+			index = (index + 1) & mask;
+		}
+		return index;
+	}
+	for (;;) {
+		const uint64_t *slot = set->slots + 2 * index;
+		if ((slot[0] == 0 && slot[1] == 0) || (slot[0] == words[0] && slot[1] == words[1])) {
+			return index;
+		}
+		index = (index + 1) & mask;
+	}
+}
+
+static void words_grow(state_set_t *set) {
+	uint64_t *old = set->slots;
+	size_t oldCapacity = set->capacity;
+	set->capacity = oldCapacity * 2;
+	set->slots = (uint64_t *)calloc(set->capacity * set->words, sizeof(uint64_t));
+	assert(set->slots);
+	for (size_t i = 0; i < oldCapacity; i++) {
+		uint64_t words[STATE_SET_MAX_WORDS] = {0};
+		memcpy(words, old + i * set->words, set->words * sizeof(uint64_t));
+		if (words[0] == 0 && words[1] == 0) {
+			continue;
+		}
+		size_t index = words_find(set, words);
+		memcpy(set->slots + index * set->words, words, set->words * sizeof(uint64_t));
+	}
+	free(old);
+}
+
+/* Bit k set where control byte k of the group equals tag. */
+static inline uint32_t group_match(const unsigned char *group, unsigned char tag) {
+#ifdef __SSE2__
+	__m128i control = _mm_loadu_si128((const __m128i *)group);
+	return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(control, _mm_set1_epi8((char)tag)));
+#else
+	uint32_t mask = 0;
+	for (int k = 0; k < SWISS_GROUP; k++) {
+		mask |= (uint32_t)(group[k] == tag) << k;
+	}
+	return mask;
+#endif
+}
+
+/*
+	Looks key up in a swiss set. The low seven bits of the hash are the
+	control byte, the rest pick the first group; groups are then visited in
+	triangular steps, which reach every group of a power of two table. With
+	no deletions, the first empty slot met ends the search and is where the
+	key belongs.
+*/
+static inline bool swiss_find(const state_set_t *set, const unsigned char *key, size_t *slot,
+	unsigned char *tag) {
+	uint64_t h = hash_bytes(key, set->keyBytes);
+	size_t mask = set->capacity / SWISS_GROUP - 1;
+	size_t group = (h >> 7) & mask;
+	*tag = (unsigned char)(h & 0x7F);
+	for (size_t step = 1; ; step++) {
+		const unsigned char *control = set->control + group * SWISS_GROUP;
+		for (uint32_t match = group_match(control, *tag); match; match &= match - 1) {
+			size_t index = group * SWISS_GROUP + __builtin_ctz(match);
+			if (memcmp(set->keys + index * set->keyBytes, key, set->keyBytes) == 0) {
+				*slot = index;
+				return true;
+			}
+		}
+		uint32_t empty = group_match(control, SWISS_EMPTY);
+		if (empty) {
+			*slot = group * SWISS_GROUP + __builtin_ctz(empty);
+			return false;
+		}
+		group = (group + step) & mask;
+	}
+}
+
+static bool swiss_allocate(state_set_t *set, size_t capacity) {
+	set->capacity = capacity;
+	set->control = (unsigned char *)malloc(capacity);
+	set->keys = (unsigned char *)malloc(capacity * set->keyBytes);
+	if (!set->control || !set->keys) {
+		return false;
+	}
+	memset(set->control, SWISS_EMPTY, capacity);
+	return true;
+}
+
+static void swiss_grow(state_set_t *set) {
+	unsigned char *oldControl = set->control;
+	unsigned char *oldKeys = set->keys;
+	size_t oldCapacity = set->capacity;
+	bool allocated = swiss_allocate(set, oldCapacity * 2);
+	assert(allocated);
+	(void)allocated;
+	for (size_t i = 0; i < oldCapacity; i++) {
+		if (oldControl[i] == SWISS_EMPTY) {
+			continue;
+		}
+		const unsigned char *key = oldKeys + i * set->keyBytes;
+		size_t slot;
+		unsigned char tag;
+		swiss_find(set, key, &slot, &tag);
+		set->control[slot] = tag;
+		memcpy(set->keys + slot * set->keyBytes, key, set->keyBytes);
+	}
+	free(oldControl);
+	free(oldKeys);
+}
+
+state_set_t *state_set_create(state_set_kind_t kind, int numPieces, int atoms, int height, int width) {
+	state_set_t *set = (state_set_t *)calloc(1, sizeof(state_set_t));
+	if (!set) {
+		return NULL;
+	}
+	set->numPieces = numPieces;
+	set->atoms = atoms;
+	set->atomBits = calcBits(numPieces) + calcBits(height) + calcBits(width);
+	set->height = height;
+	set->width = width;
+	int keyBits = atoms * set->atomBits;
+	set->keyBytes = (keyBits + 7) / 8;
+	if (kind == STATE_SET_AUTO) {
+		kind = STATE_SET_WORDS;
+	}
+	/* The board limits in gate.h give keys of at most 117 bits. */
+	assert(kind != STATE_SET_WORDS || keyBits <= 64 * STATE_SET_MAX_WORDS);
+	set->kind = kind;
+	bool ok = true;
+	if (kind == STATE_SET_RADIX) {
+		set->tree = getNewRadixTree(numPieces, height, width);
+		ok = set->tree != NULL;
+	} else if (kind == STATE_SET_WORDS) {
+		set->words = keyBits <= 64 ? 1 : 2;
+		set->capacity = STATE_SET_INITIAL_CAPACITY;
+		set->slots = (uint64_t *)calloc(set->capacity * set->words, sizeof(uint64_t));
+		ok = set->slots != NULL;
+	} else {
+		ok = swiss_allocate(set, STATE_SET_INITIAL_CAPACITY);
+	}
+	if (!ok) {
+		state_set_free(set);
+		return NULL;
+	}
+	return set;
+}
+
+bool state_set_kind_named(const char *name, state_set_kind_t *kind) {
+	static const char *const names[] = {"radix", "words", "swiss", "auto"};
+	for (int k = 0; k <= STATE_SET_AUTO; k++) {
+		if (strcmp(name, names[k]) == 0) {
+			*kind = (state_set_kind_t)k;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool state_set_contains(state_set_t *set, const unsigned char *key) {
+	if (set->kind == STATE_SET_RADIX) {
+		return checkPresent(set->tree, (unsigned char *)key, set->atoms) == PRESENT;
+	}
+	if (set->kind == STATE_SET_SWISS) {
+		size_t slot;
+		unsigned char tag;
+		return swiss_find(set, key, &slot, &tag);
+	}
+	uint64_t words[STATE_SET_MAX_WORDS];
+	load_words(set, key, words);
+	if (words[0] == 0 && words[1] == 0) {
+		return set->hasZero;
+	}
+	return !words_empty(set, set->slots + words_find(set, words) * set->words);
+}
+
+void state_set_insert(state_set_t *set, const unsigned char *key) {
+	if (set->kind == STATE_SET_RADIX) {
+		insertRadixTree(set->tree, (unsigned char *)key, set->atoms);
+		return;
+	}
+	if (set->kind == STATE_SET_SWISS) {
+		/* Seven eighths full, as SwissTable allows. */
+		if ((set->count + 1) * 8 > set->capacity * 7) {
+			swiss_grow(set);
+		}
+		size_t slot;
+		unsigned char tag;
+		if (!swiss_find(set, key, &slot, &tag)) {
+			set->control[slot] = tag;
+			memcpy(set->keys + slot * set->keyBytes, key, set->keyBytes);
+			set->count++;
+		}
+		return;
+	}
+	uint64_t words[STATE_SET_MAX_WORDS];
+	load_words(set, key, words);
+	if (words[0] == 0 && words[1] == 0) {
+		set->hasZero = true;
+		return;
+	}
+	/* Linear probing stays short below three quarters full. */
+	if ((set->count + 1) * 4 > set->capacity * 3) {
+		words_grow(set);
+	}
+	uint64_t *slot = set->slots + words_find(set, words) * set->words;
+	if (words_empty(set, slot)) {
+		memcpy(slot, words, set->words * sizeof(uint64_t));
+		set->count++;
+	}
+}
+
+bool state_set_contains_subsets(state_set_t *set, const unsigned char *fullKey) {
+	if (set->kind == STATE_SET_RADIX) {
+		return checkPresentnCr(set->tree, fullKey, set->atoms) == PRESENT;
+	}
+	unsigned char subset[RADIX_MAX_SUBSET_BYTES];
+	struct atomSubsets subsets;
+	startAtomSubsets(&subsets, fullKey, set->numPieces, set->atoms, set->atomBits, subset);
+	do {
+		if (!state_set_contains(set, subset)) {
+			return false;
+		}
+	} while (nextAtomSubset(&subsets));
+	return true;
+}
+
+void state_set_insert_subsets(state_set_t *set, const unsigned char *fullKey) {
+	if (set->kind == STATE_SET_RADIX) {
+		insertRadixTreenCr(set->tree, fullKey, set->atoms);
+		return;
+	}
+	unsigned char subset[RADIX_MAX_SUBSET_BYTES];
+	struct atomSubsets subsets;
+	startAtomSubsets(&subsets, fullKey, set->numPieces, set->atoms, set->atomBits, subset);
+	do {
+		state_set_insert(set, subset);
+	} while (nextAtomSubset(&subsets));
+}
+
+size_t state_set_memory(const state_set_t *set) {
+	if (set->kind == STATE_SET_RADIX) {
+		return queryRadixMemoryUsage(set->tree);
+	}
+	if (set->kind == STATE_SET_SWISS) {
+		return sizeof(state_set_t) + set->capacity * (1 + set->keyBytes);
+	}
+	return sizeof(state_set_t) + set->capacity * set->words * sizeof(uint64_t);
+}
+
+/* Calls visit with every key in a words or swiss set, in packed form. */
+static bool each_key(const state_set_t *set, bool (*visit)(const unsigned char *key, void *context),
+	void *context) {
+	if (set->kind == STATE_SET_SWISS) {
+		for (size_t i = 0; i < set->capacity; i++) {
+			if (set->control[i] != SWISS_EMPTY && !visit(set->keys + i * set->keyBytes, context)) {
+				return false;
+			}
+		}
+		return true;
+	}
+	unsigned char key[STATE_SET_MAX_WORDS * sizeof(uint64_t)];
+	if (set->hasZero) {
+		memset(key, 0, sizeof(key));
+		if (!visit(key, context)) {
+			return false;
+		}
+	}
+	for (size_t i = 0; i < set->capacity; i++) {
+		const uint64_t *slot = set->slots + i * set->words;
+		if (words_empty(set, slot)) {
+			continue;
+		}
+		uint64_t words[STATE_SET_MAX_WORDS] = {0};
+		memcpy(words, slot, set->words * sizeof(uint64_t));
+		memcpy(key, words, set->keyBytes);
+		if (!visit(key, context)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+typedef struct key_writer {
+	FILE *file;
+	size_t keyBytes;
+} key_writer_t;
+
+static bool write_packed_key(const unsigned char *key, void *context) {
+	key_writer_t *writer = (key_writer_t *)context;
+	return fwrite(key, 1, writer->keyBytes, writer->file) == writer->keyBytes;
+}
+
+bool state_set_write(state_set_t *set, FILE *file) {
+	state_set_header_t header;
+	memset(&header, 0, sizeof(header));
+	header.kind = set->kind;
+	header.keyBytes = set->keyBytes;
+	header.count = set->count + (set->hasZero ? 1 : 0);
+	if (fwrite(&header, sizeof(header), 1, file) != 1) {
+		return false;
+	}
+	if (set->kind == STATE_SET_RADIX) {
+		return writeRadixTree(set->tree, file);
+	}
+	key_writer_t writer = {file, set->keyBytes};
+	return each_key(set, write_packed_key, &writer);
+}
+
+state_set_t *state_set_read(FILE *file, int numPieces, int atoms, int height, int width) {
+	state_set_header_t header;
+	if (fread(&header, sizeof(header), 1, file) != 1 || header.kind < STATE_SET_RADIX
+		|| header.kind >= STATE_SET_AUTO || header.count < 0) {
+		return NULL;
+	}
+	state_set_t *set = state_set_create((state_set_kind_t)header.kind, numPieces, atoms, height, width);
+	if (!set) {
+		return NULL;
+	}
+	if (header.kind != (int32_t)set->kind || header.keyBytes != set->keyBytes) {
+		state_set_free(set);
+		return NULL;
+	}
+	if (set->kind == STATE_SET_RADIX) {
+		freeRadixTree(set->tree);
+		set->tree = readRadixTree(file, numPieces, height, width);
+		if (!set->tree) {
+			state_set_free(set);
+			return NULL;
+		}
+		return set;
+	}
+	unsigned char key[RADIX_MAX_SUBSET_BYTES];
+	for (int64_t i = 0; i < header.count; i++) {
+		if (fread(key, 1, set->keyBytes, file) != (size_t)set->keyBytes) {
+			state_set_free(set);
+			return NULL;
+		}
+		state_set_insert(set, key);
+	}
+	return set;
+}
+
+static bool insert_into_tree(const unsigned char *key, void *context) {
+	const state_set_t *set = (const state_set_t *)context;
+	insertRadixTree(set->tree, (unsigned char *)key, set->atoms);
+	return true;
+}
+
+bool state_set_save_tree(state_set_t *set, const char *path, uint64_t board, bool symmetry) {
+	if (set->kind == STATE_SET_RADIX) {
+		return saveRadixTree(set->tree, path, board, symmetry);
+	}
+	/* A radix tree view of the same keys, built only for the file. */
+	state_set_t view = *set;
+	view.tree = getNewRadixTree(set->numPieces, set->height, set->width);
+	if (!view.tree) {
+		return false;
+	}
+	each_key(set, insert_into_tree, &view);
+	bool ok = saveRadixTree(view.tree, path, board, symmetry);
+	freeRadixTree(view.tree);
+	return ok;
+}
+
+void state_set_free(state_set_t *set) {
+	if (!set) {
+		return;
+	}
+	if (set->tree) {
+		freeRadixTree(set->tree);
+	}
+	free(set->slots);
+	free(set->control);
+	free(set->keys);
+	free(set);
+}
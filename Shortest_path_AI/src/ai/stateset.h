@@ -0,0 +1,95 @@
+/*
+ * Sets of packed keys, for the closed set and the novelty sets of a search.
+ * Three kinds sit behind the same calls:
+ * - words: a key of at most 128 bits held as one or two machine words in
+ *   an open-addressing table, so a lookup is a hash of the words and a probe
+ *   of a flat array.
+ * - swiss: keys of any width stored inline, found by probing sixteen control
+ *   bytes at a time, as SwissTable does.
+ * - radix: the radix tree, the most compact of the three.
+ * Any kind can be written into a checkpoint, and saved in the radix tree
+ * format that --load-tree maps.
+*/
+#ifndef __STATESET__
+#define __STATESET__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "radix.h"
+
+/* Widest key held in machine words. */
+#define STATE_SET_MAX_WORDS 2
+
+typedef enum state_set_kind {
+	STATE_SET_RADIX,
+	STATE_SET_WORDS,
+	STATE_SET_SWISS,
+	/* The default, words. Asked for, never held. */
+	STATE_SET_AUTO
+} state_set_kind_t;
+
+typedef struct state_set {
+	state_set_kind_t kind;
+	int numPieces;
+	/* Atoms (pieces) in each key, numPieces except for novelty sets. */
+	int atoms;
+	int atomBits;
+	int height;
+	int width;
+	int keyBytes;
+	size_t count;
+	/* STATE_SET_RADIX */
+	struct radixTree *tree;
+	/* STATE_SET_WORDS: capacity slots of words each; an all-zero slot is empty. */
+	int words;
+	uint64_t *slots;
+	size_t capacity;
+	/* The all-zero key cannot be told from an empty slot, so it is kept here. */
+	bool hasZero;
+	/* STATE_SET_SWISS: a control byte and keyBytes of key per slot. */
+	unsigned char *control;
+	unsigned char *keys;
+} state_set_t;
+
+/*
+	Creates an empty set for keys of atoms pieces, for the given piece count
+	and board size. Every key within the board limits fits in words.
+*/
+state_set_t *state_set_create(state_set_kind_t kind, int numPieces, int atoms, int height, int width);
+
+/* Reads a kind from its name: auto, radix, words or swiss. */
+bool state_set_kind_named(const char *name, state_set_kind_t *kind);
+
+bool state_set_contains(state_set_t *set, const unsigned char *key);
+
+/* Adds key; a key already present is left alone. */
+void state_set_insert(state_set_t *set, const unsigned char *key);
+
+/* Whether every subset of the set's atom count from the full key is present. */
+bool state_set_contains_subsets(state_set_t *set, const unsigned char *fullKey);
+
+/* Adds every subset of the set's atom count from the full key. */
+void state_set_insert_subsets(state_set_t *set, const unsigned char *fullKey);
+
+/* Bytes held by the set, comparable with queryRadixMemoryUsage(). */
+size_t state_set_memory(const state_set_t *set);
+
+/* Writes the set at the current position of file. Returns false on an I/O error. */
+bool state_set_write(state_set_t *set, FILE *file);
+
+/*
+	Reads a set written by state_set_write, of the kind it was written as.
+	Returns NULL if it was written for other keys or board size, or on an
+	I/O error.
+*/
+state_set_t *state_set_read(FILE *file, int numPieces, int atoms, int height, int width);
+
+/* Saves the keys to path as a radix tree file, as saveRadixTree does. */
+bool state_set_save_tree(state_set_t *set, const char *path, uint64_t board, bool symmetry);
+
+void state_set_free(state_set_t *set);
+
+#endif
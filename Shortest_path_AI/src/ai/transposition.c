@@ -0,0 +1,103 @@
+#include "transposition.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/* Header of every slot, followed directly by the packed key. */
+struct ttEntry {
+    uint64_t hash;
+    int32_t depth;
+    int32_t iteration;
+    int32_t bound;
+    int32_t used;
+};
+
+struct transpositionTable {
+    int keyBytes;
+    size_t entryBytes;
+    size_t entryCount;
+    unsigned char *entries;
+
+    long probes;
+    long hits;
+    long replacements;
+};
+
+static struct ttEntry *getEntry(struct transpositionTable *table, uint64_t hash) {
+    return (struct ttEntry *) (table->entries + (hash % table->entryCount) * table->entryBytes);
+}
+
+struct transpositionTable *getNewTranspositionTable(size_t memoryBudget, int keyBytes) {
+    struct transpositionTable *table = (struct transpositionTable *) malloc(sizeof(struct transpositionTable));
+    assert(table);
+
+    table->keyBytes = keyBytes;
+    /* Keep every slot 8-byte aligned. */
+    table->entryBytes = (sizeof(struct ttEntry) + keyBytes + 7) / 8 * 8;
+    table->entryCount = memoryBudget / table->entryBytes;
+    if(table->entryCount == 0) {
+        table->entryCount = 1;
+    }
+    table->entries = (unsigned char *) calloc(table->entryCount, table->entryBytes);
+    assert(table->entries);
+
+    table->probes = 0;
+    table->hits = 0;
+    table->replacements = 0;
+
+    return table;
+}
+
+int lookupTransposition(struct transpositionTable *table, uint64_t hash, const unsigned char *key,
+    int *depth, int *iteration, int *bound) {
+    struct ttEntry *entry = getEntry(table, hash);
+    table->probes++;
+    if(! entry->used || entry->hash != hash
+        || memcmp((unsigned char *) (entry + 1), key, table->keyBytes) != 0) {
+        return TT_NOTFOUND;
+    }
+    table->hits++;
+    *depth = entry->depth;
+    *iteration = entry->iteration;
+    *bound = entry->bound;
+    return TT_FOUND;
+}
+
+void storeTransposition(struct transpositionTable *table, uint64_t hash, const unsigned char *key,
+    int depth, int iteration, int bound) {
+    struct ttEntry *entry = getEntry(table, hash);
+    unsigned char *entryKey = (unsigned char *) (entry + 1);
+    if(entry->used && (entry->hash != hash || memcmp(entryKey, key, table->keyBytes) != 0)) {
+        table->replacements++;
+    }
+    entry->hash = hash;
+    entry->depth = depth;
+    entry->iteration = iteration;
+    entry->bound = bound;
+    entry->used = 1;
+    memcpy(entryKey, key, table->keyBytes);
+}
+
+size_t queryTranspositionCapacity(struct transpositionTable *table) {
+    return table->entryCount;
+}
+
+size_t queryTranspositionMemoryUsage(struct transpositionTable *table) {
+    return table->entryCount * table->entryBytes;
+}
+
+void queryTranspositionStats(struct transpositionTable *table, long *probes, long *hits, long *replacements) {
+    *probes = table->probes;
+    *hits = table->hits;
+    *replacements = table->replacements;
+}
+
+void freeTranspositionTable(struct transpositionTable *table) {
+    if(! table) {
+        return;
+    }
+    if(table->entries) {
+        free(table->entries);
+    }
+    free(table);
+}
@@ -0,0 +1,43 @@
+/*
+ * Fixed-size transposition table keyed by packed states. Memory is allocated
+ * once from a byte budget; a store into an occupied slot replaces whatever
+ * was there, so the table never grows.
+*/
+#ifndef __TRANSPOSITION__
+#define __TRANSPOSITION__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define TT_NOTFOUND (0)
+#define TT_FOUND (1)
+
+struct transpositionTable;
+
+/* Creates a table using at most memoryBudget bytes for keys of keyBytes bytes. */
+struct transpositionTable *getNewTranspositionTable(size_t memoryBudget, int keyBytes);
+
+/*
+	Looks up the packed state. On a match, writes the depth and iteration it was
+	stored at and its stored lower bound on the remaining cost.
+*/
+int lookupTransposition(struct transpositionTable *table, uint64_t hash, const unsigned char *key,
+	int *depth, int *iteration, int *bound);
+
+/* Stores the packed state, replacing any other state in its slot. */
+void storeTransposition(struct transpositionTable *table, uint64_t hash, const unsigned char *key,
+	int depth, int iteration, int bound);
+
+/* Number of slots in the table. */
+size_t queryTranspositionCapacity(struct transpositionTable *table);
+
+/* Return memory used by the table. */
+size_t queryTranspositionMemoryUsage(struct transpositionTable *table);
+
+/* Counters since creation: lookups, lookups that matched, stores that evicted another state. */
+void queryTranspositionStats(struct transpositionTable *table, long *probes, long *hits, long *replacements);
+
+/* Free transposition table */
+void freeTranspositionTable(struct transpositionTable *table);
+
+#endif
@@ -0,0 +1,286 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "verify.h"
+#include "utils.h"
+
+/* Index of the piece drawn by a map character, or -1 for anything else. */
+static int piece_of(char cell) {
+	if (cell >= '0' && cell <= '9') {
+		return cell - '0';
+	}
+	if (cell >= 'H' && cell <= 'Q') {
+		return cell - 'H';
+	}
+	return -1;
+}
+
+bool verify_init(verify_grid_t *grid, char **map, int lines) {
+	if (lines > MAX_ROWS) {
+		return false;
+	}
+	memset(grid->cell, '\0', sizeof(grid->cell));
+	memset(grid->goal, 0, sizeof(grid->goal));
+	memset(grid->cellCount, 0, sizeof(grid->cellCount));
+	grid->lines = lines;
+	grid->uncovered = 0;
+	for (int i = 0; i < lines; i++) {
+		int length = strlen(map[i]);
+		if (length > MAX_COLUMNS) {
+			return false;
+		}
+		for (int j = 0; j < length; j++) {
+			char cell = map[i][j];
+			if (cell != ' ' && cell != '#' && !(cell >= '0' && cell <= '9') && !(cell >= 'G' && cell <= 'Q')) {
+				return false;
+			}
+			int piece = piece_of(cell);
+			if (piece >= MAX_PIECES) {
+				return false;
+			}
+			grid->cell[i][j] = cell;
+			grid->goal[i][j] = cell >= 'G' && cell <= 'Q';
+			if (piece >= 0) {
+				grid->cellY[piece][grid->cellCount[piece]] = i;
+				grid->cellX[piece][grid->cellCount[piece]] = j;
+				grid->cellCount[piece]++;
+			}
+			if (grid->goal[i][j] && cell != 'H') {
+				grid->uncovered++;
+			}
+		}
+	}
+	return true;
+}
+
+bool verify_load(verify_grid_t *grid, const char *path) {
+	FILE *file = fopen(path, "r");
+	if (!file) {
+		return false;
+	}
+	char *lines[MAX_ROWS + 1];
+	int lineCount = 0;
+	char *line = NULL;
+	size_t capacity = 0;
+	ssize_t length;
+	bool valid = true;
+	/* As in make_map(), only newline-terminated lines are part of the map. */
+	while ((length = getline(&line, &capacity, file)) > 0 && line[length - 1] == '\n') {
+		if (lineCount == MAX_ROWS) {
+			valid = false;
+			break;
+		}
+		line[length - 1] = '\0';
+		lines[lineCount++] = line;
+		line = NULL;
+		capacity = 0;
+	}
+	fclose(file);
+	if (line) {
+		free(line);
+	}
+	valid = valid && verify_init(grid, lines, lineCount);
+	for (int i = 0; i < lineCount; i++) {
+		free(lines[i]);
+	}
+	return valid;
+}
+
+verify_status_t verify_move(verify_grid_t *grid, char piece, char direction) {
+	int dy = 0;
+	int dx = 0;
+	if (direction == 'u') {
+		dy = -1;
+	} else if (direction == 'd') {
+		dy = 1;
+	} else if (direction == 'l') {
+		dx = -1;
+	} else if (direction == 'r') {
+		dx = 1;
+	} else {
+		return VERIFY_MALFORMED;
+	}
+	if (piece < '0' || piece > '9') {
+		return VERIFY_MALFORMED;
+	}
+	int p = piece - '0';
+	if (p >= MAX_PIECES || grid->cellCount[p] == 0) {
+		return VERIFY_NO_PIECE;
+	}
+
+	int count = grid->cellCount[p];
+	unsigned char *ys = grid->cellY[p];
+	unsigned char *xs = grid->cellX[p];
+	for (int k = 0; k < count; k++) {
+		int y = ys[k] + dy;
+		int x = xs[k] + dx;
+		if (y < 0 || y >= grid->lines || x < 0) {
+			return VERIFY_BLOCKED;
+		}
+		char target = grid->cell[y][x];
+		if (target != ' ' && target != 'G' && piece_of(target) != p) {
+			return VERIFY_BLOCKED;
+		}
+	}
+
+	/* Lift the piece off every cell, then put it down one step further. */
+	for (int k = 0; k < count; k++) {
+		bool goal = grid->goal[ys[k]][xs[k]];
+		grid->cell[ys[k]][xs[k]] = goal ? 'G' : ' ';
+		if (goal && p == 0) {
+			grid->uncovered++;
+		}
+	}
+	for (int k = 0; k < count; k++) {
+		ys[k] += dy;
+		xs[k] += dx;
+		bool goal = grid->goal[ys[k]][xs[k]];
+		grid->cell[ys[k]][xs[k]] = goal ? 'H' + p : '0' + p;
+		if (goal && p == 0) {
+			grid->uncovered--;
+		}
+	}
+	return VERIFY_OK;
+}
+
+bool verify_solved(const verify_grid_t *grid) {
+	return grid->uncovered == 0;
+}
+
+verify_result_t verify_solution(verify_grid_t *grid, const char *solution) {
+	verify_result_t result;
+	result.moves = 0;
+	result.piece = '\0';
+	result.direction = '\0';
+	for (const char *move = solution; *move != '\0'; move += 2) {
+		result.piece = move[0];
+		result.direction = move[1];
+		result.status = move[1] == '\0' ? VERIFY_MALFORMED : verify_move(grid, move[0], move[1]);
+		if (result.status != VERIFY_OK) {
+			return result;
+		}
+		result.moves++;
+	}
+	result.piece = '\0';
+	result.direction = '\0';
+	result.status = verify_solved(grid) ? VERIFY_SOLVED : VERIFY_UNSOLVED;
+	return result;
+}
+
+void verify_copy_map(const verify_grid_t *grid, char **map) {
+	for (int i = 0; i < grid->lines; i++) {
+		memcpy(map[i], grid->cell[i], strlen(map[i]));
+	}
+}
+
+const char *verify_status_name(verify_status_t status) {
+	switch (status) {
+	case VERIFY_OK:
+		return "legal move";
+	case VERIFY_SOLVED:
+		return "solved";
+	case VERIFY_UNSOLVED:
+		return "goal not covered";
+	case VERIFY_MALFORMED:
+		return "malformed move";
+	case VERIFY_NO_PIECE:
+		return "piece not on the board";
+	case VERIFY_BLOCKED:
+		return "blocked";
+	}
+	return "unknown";
+}
+
+/* Prints the outcome of one replay, after the given prefix. */
+static void print_result(const char *prefix, const verify_result_t *result) {
+	if (result->status == VERIFY_SOLVED || result->status == VERIFY_UNSOLVED) {
+		printf("%s%s after %d moves\n", prefix, verify_status_name(result->status), result->moves);
+	} else {
+		printf("%smove %d (%c%c) %s\n", prefix, result->moves + 1, result->piece,
+			result->direction ? result->direction : '?', verify_status_name(result->status));
+	}
+}
+
+int verify(char const *path, char const *solution) {
+	verify_grid_t grid;
+	if (!verify_load(&grid, path)) {
+		printf("Unable to read puzzle %s\n", path);
+		return 1;
+	}
+	verify_result_t result = verify_solution(&grid, solution);
+	print_result("Solution ", &result);
+	return result.status == VERIFY_SOLVED ? 0 : 1;
+}
+
+int verify_batch(char const *listPath) {
+	FILE *list = strcmp(listPath, "-") == 0 ? stdin : fopen(listPath, "r");
+	if (!list) {
+		printf("Unable to read %s\n", listPath);
+		return 1;
+	}
+	/* Consecutive pairs for the same puzzle reuse the grid read for the first. */
+	verify_grid_t start;
+	verify_grid_t grid;
+	char *loadedPath = NULL;
+	bool loaded = false;
+	char *line = NULL;
+	size_t capacity = 0;
+	long total = 0;
+	long solved = 0;
+	double startTime = now();
+
+	while (getline(&line, &capacity, list) > 0) {
+		char *path = line;
+		while (isspace((unsigned char)*path)) {
+			path++;
+		}
+		if (*path == '\0') {
+			continue;
+		}
+		char *solution = path;
+		while (*solution != '\0' && !isspace((unsigned char)*solution)) {
+			solution++;
+		}
+		if (*solution != '\0') {
+			*solution++ = '\0';
+		}
+		while (isspace((unsigned char)*solution)) {
+			solution++;
+		}
+		char *end = solution;
+		while (*end != '\0' && !isspace((unsigned char)*end)) {
+			end++;
+		}
+		*end = '\0';
+
+		total++;
+		if (!loadedPath || strcmp(loadedPath, path) != 0) {
+			free(loadedPath);
+			loadedPath = strdup(path);
+			loaded = verify_load(&start, path);
+		}
+		printf("%s: ", path);
+		if (!loaded) {
+			printf("unable to read puzzle\n");
+			continue;
+		}
+		memcpy(&grid, &start, sizeof(verify_grid_t));
+		verify_result_t result = verify_solution(&grid, solution);
+		print_result("", &result);
+		if (result.status == VERIFY_SOLVED) {
+			solved++;
+		}
+	}
+
+	double elapsed = now() - startTime;
+	printf("Verified %ld of %ld solutions in %lf seconds (%.0lf per second)\n", solved, total, elapsed,
+		elapsed > 0 ? total / elapsed : 0.0);
+	free(line);
+	free(loadedPath);
+	if (list != stdin) {
+		fclose(list);
+	}
+	return solved == total ? 0 : 1;
+}
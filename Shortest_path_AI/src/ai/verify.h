@@ -0,0 +1,81 @@
+/*
+ * Headless replay of move strings. A puzzle is held as a fixed-size grid
+ * with a list of cells per piece, so a move touches only the cells of the
+ * piece being moved and the win test is a counter of goal cells not yet
+ * under piece 0. Nothing here draws to the screen or copies a gate_t.
+*/
+#ifndef __VERIFY__
+#define __VERIFY__
+
+#include <stdbool.h>
+
+#include "gate.h"
+#include "board.h"
+
+typedef enum verify_status {
+	/* The move was made. */
+	VERIFY_OK,
+	/* Every move was legal and the last one covers the goal. */
+	VERIFY_SOLVED,
+	/* Every move was legal but the goal is not covered. */
+	VERIFY_UNSOLVED,
+	/* Odd length, or a character that is not a piece digit or u/d/l/r. */
+	VERIFY_MALFORMED,
+	/* The piece does not appear on the board. */
+	VERIFY_NO_PIECE,
+	/* A wall or another piece is in the way. */
+	VERIFY_BLOCKED
+} verify_status_t;
+
+typedef struct verify_grid {
+	int lines;
+	/* Map characters; cells past the end of a row are '\0' and block moves. */
+	char cell[MAX_ROWS][MAX_COLUMNS + 1];
+	bool goal[MAX_ROWS][MAX_COLUMNS];
+	int cellCount[MAX_PIECES];
+	unsigned char cellY[MAX_PIECES][BOARD_MAX_CELLS];
+	unsigned char cellX[MAX_PIECES][BOARD_MAX_CELLS];
+	/* Goal cells not covered by piece 0; the puzzle is solved at zero. */
+	int uncovered;
+} verify_grid_t;
+
+typedef struct verify_result {
+	verify_status_t status;
+	/* Moves made before the replay stopped. */
+	int moves;
+	/* The offending move, for the failing statuses other than VERIFY_UNSOLVED. */
+	char piece;
+	char direction;
+} verify_result_t;
+
+/* Builds a grid from map lines. Returns false if the map does not fit or has an unknown character. */
+bool verify_init(verify_grid_t *grid, char **map, int lines);
+
+/* Reads a puzzle file into a grid. Returns false if it cannot be read or is not a valid map. */
+bool verify_load(verify_grid_t *grid, const char *path);
+
+/* Makes one move, returning VERIFY_OK or the reason it is illegal; the grid is unchanged on failure. */
+verify_status_t verify_move(verify_grid_t *grid, char piece, char direction);
+
+/* Whether piece 0 covers every goal cell. */
+bool verify_solved(const verify_grid_t *grid);
+
+/* Replays a move string on the grid, stopping at the first illegal move. */
+verify_result_t verify_solution(verify_grid_t *grid, const char *solution);
+
+/* Copies the grid's cells back into map lines of the puzzle it was built from. */
+void verify_copy_map(const verify_grid_t *grid, char **map);
+
+/* Short description of a status. */
+const char *verify_status_name(verify_status_t status);
+
+/* `gate -v puzzle solution`: replays one solution and prints the outcome. Returns 0 if it solves the puzzle. */
+int verify(char const *path, char const *solution);
+
+/*
+	`gate -v --batch FILE`: verifies one "puzzle solution" pair per line of
+	FILE ("-" for standard input). Returns 0 if every pair solves its puzzle.
+*/
+int verify_batch(char const *listPath);
+
+#endif
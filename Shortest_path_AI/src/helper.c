@@ -12,9 +12,37 @@
 
 int helper(void) {
 	my_putstr("USAGE\n");
-	my_putstr("	./gate <-s> puzzle\n\n");
+	my_putstr("	./gate <-s> puzzle <algorithm> <options>\n");
+	my_putstr("	./gate -v puzzle solution\n");
+	my_putstr("	./gate -v --batch FILE\n\n");
 	my_putstr("DESCRIPTION\n");
 	my_putstr(" Arguments within <> are optional\n");
 	my_putstr("    -s                 calls the AI solver\n");
+	my_putstr("    -v                 replays a solution without the display and reports\n");
+	my_putstr("                       the first illegal move; --batch reads one\n");
+	my_putstr("                       \"puzzle solution\" pair per line of FILE (- for stdin)\n");
+	my_putstr("    algorithm          1: IW(n+1), 2: UCS, 3: IW(1..n) then UCS, 4: IDA*,\n");
+	my_putstr("                       5: external-memory BFS\n");
+	my_putstr("\nSOLVER OPTIONS\n");
+	my_putstr("    --no-symmetry      keep identical pieces distinct\n");
+	my_putstr("    --slide            move a piece any number of cells per action\n");
+	my_putstr("    --tt-memory MB     IDA* transposition table size (default 64)\n");
+	my_putstr("    --scratch DIR      directory for external BFS layer files (default .)\n");
+	my_putstr("    --sort-memory MB   external BFS in-memory sort buffer (default 64)\n");
+	my_putstr("    --save-tree FILE   write the closed set of algorithms 1-3 to FILE if no solution exists\n");
+	my_putstr("    --load-tree FILE   skip states in a closed set saved by --save-tree\n");
+	my_putstr("    --cache DIR        reuse and store verified solutions in DIR\n");
+	my_putstr("    --cache-limit MB   evict least recently used entries above this (default 64)\n");
+	my_putstr("    --checkpoint FILE  snapshot algorithms 1-3 to FILE periodically and on SIGTERM\n");
+	my_putstr("    --checkpoint-seconds S   seconds between snapshots (default 300)\n");
+	my_putstr("    --checkpoint-nodes N     also snapshot every N expansions\n");
+	my_putstr("    --resume FILE      continue the search saved in FILE\n");
+	my_putstr("    --max-nodes N      stop algorithms 1-3 after N expansions\n");
+	my_putstr("    --max-seconds S    stop algorithms 1-3 after S seconds\n");
+	my_putstr("    --max-memory MB    stop algorithms 1-3 once peak memory reaches MB\n");
+	my_putstr("    --post-optimize S  spend up to S seconds shortening the solution found\n");
+	my_putstr("    --capture-keys FILE  write the open-set keys algorithms 1-3 look up to FILE\n");
+	my_putstr("    --state-set KIND   closed and novelty sets of algorithms 1-3: auto, radix,\n");
+	my_putstr("                       words or swiss (default auto)\n");
 	return (0);
 }
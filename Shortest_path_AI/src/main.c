@@ -11,25 +11,95 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <stdlib.h>
+#include <string.h>
 #include "../include/libmy.h"
 #include "../include/gate.h"
 #include "ai/ai.h"
+#include "ai/verify.h"
+
+/* Reads solver options following the puzzle (and optional algorithm). */
+static int parse_solver_options(int argc, char const **argv, int first) {
+	for (int i = first; i < argc; i++) {
+		if (strcmp(argv[i], "--no-symmetry") == 0) {
+			set_solver_symmetry(false);
+		} else if (strcmp(argv[i], "--slide") == 0) {
+			set_solver_slide(true);
+		} else if (strcmp(argv[i], "--tt-memory") == 0 && i + 1 < argc) {
+			set_solver_tt_memory((size_t)atol(argv[++i]) * 1024 * 1024);
+		} else if (strcmp(argv[i], "--scratch") == 0 && i + 1 < argc) {
+			set_solver_scratch(argv[++i], 0);
+		} else if (strcmp(argv[i], "--sort-memory") == 0 && i + 1 < argc) {
+			set_solver_scratch(NULL, (size_t)atol(argv[++i]) * 1024 * 1024);
+		} else if (strcmp(argv[i], "--save-tree") == 0 && i + 1 < argc) {
+			set_solver_trees(argv[++i], NULL);
+		} else if (strcmp(argv[i], "--load-tree") == 0 && i + 1 < argc) {
+			set_solver_trees(NULL, argv[++i]);
+		} else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+			set_solver_cache(argv[++i], 0);
+		} else if (strcmp(argv[i], "--cache-limit") == 0 && i + 1 < argc) {
+			set_solver_cache(NULL, atol(argv[++i]) * 1024 * 1024);
+		} else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+			set_solver_checkpoint(argv[++i], 0, 0);
+		} else if (strcmp(argv[i], "--checkpoint-seconds") == 0 && i + 1 < argc) {
+			set_solver_checkpoint(NULL, atof(argv[++i]), 0);
+		} else if (strcmp(argv[i], "--checkpoint-nodes") == 0 && i + 1 < argc) {
+			set_solver_checkpoint(NULL, 0, atol(argv[++i]));
+		} else if (strcmp(argv[i], "--resume") == 0 && i + 1 < argc) {
+			set_solver_resume(argv[++i]);
+		} else if (strcmp(argv[i], "--max-nodes") == 0 && i + 1 < argc) {
+			set_solver_limits(atol(argv[++i]), 0, 0);
+		} else if (strcmp(argv[i], "--max-seconds") == 0 && i + 1 < argc) {
+			set_solver_limits(0, atof(argv[++i]), 0);
+		} else if (strcmp(argv[i], "--max-memory") == 0 && i + 1 < argc) {
+			set_solver_limits(0, 0, atol(argv[++i]) * 1024 * 1024);
+		} else if (strcmp(argv[i], "--post-optimize") == 0 && i + 1 < argc) {
+			set_solver_post_optimize(atof(argv[++i]));
+		} else if (strcmp(argv[i], "--capture-keys") == 0 && i + 1 < argc) {
+			set_solver_capture_keys(argv[++i]);
+		} else if (strcmp(argv[i], "--state-set") == 0 && i + 1 < argc) {
+			if (!set_solver_state_set(argv[++i])) {
+				return (84);
+			}
+		} else {
+			return (84);
+		}
+	}
+	return (0);
+}
 
 int main(int argc, char const **argv) {
-	if (argc < 2 || argc > 4){
+	if (argc < 2){
 		helper();
 		return (84);
 	}
 	if (argv[1][0] == '-' && argv[1][1] == 'h') {
 		return(helper());
 	} else if (argv[1][0] == '-' && argv[1][1] == 's') {
-		int algorithm = 3;
-		if (argc == 4) {
-			algorithm = atoi(argv[3]);
+		if (argc < 3) {
+			helper();
+			return (84);
+		}
+		int optionStart = 3;
+		if (argc > 3 && argv[3][0] != '-') {
+			int algorithm = atoi(argv[3]);
 			set_solver_algorithm(algorithm);
+			optionStart = 4;
+		}
+		if (parse_solver_options(argc, argv, optionStart) != 0) {
+			helper();
+			return (84);
 		}
 		solve(argv[2]);
 		return 0;
+	} else if (argv[1][0] == '-' && argv[1][1] == 'v') {
+		if (argc == 4 && strcmp(argv[2], "--batch") == 0) {
+			return (verify_batch(argv[3]));
+		}
+		if (argc < 3 || argc > 4) {
+			helper();
+			return (84);
+		}
+		return (verify(argv[2], argc == 4 ? argv[3] : ""));
 	} else if (argv[1][0] != '-') {
 		helper();
 		return(play(argv[1]));
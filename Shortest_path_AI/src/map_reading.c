@@ -61,8 +61,6 @@ gate_t count_lines(gate_t gate) {
 	return (gate);
 }
 
-#define MAX_COLUMNS (26+2)
-#define MAX_ROWS (9+2)
 #include <assert.h>
 
 gate_t make_map(char const *path, gate_t gate) {
@@ -72,6 +70,7 @@ gate_t make_map(char const *path, gate_t gate) {
 	int k = 0;
 	int columns = 0;
 	gate.num_chars_map = 0;
+	gate.goals_uncovered = 0;
 	gate.map = malloc(sizeof(char *) * gate.lines);
 	gate.map_save = malloc(sizeof (char *) * gate.lines);
 	for (int j = 0; j < gate.lines; j++) {
@@ -81,6 +80,9 @@ gate_t make_map(char const *path, gate_t gate) {
 		gate.map_save[j] = malloc(sizeof(char) * columns + 1);
 		for (int i = 0; i < columns; i++) {
 			gate.map[j][i] = gate.buffer[k];
+			if (gate.buffer[k] == 'G' || (gate.buffer[k] >= 'I' && gate.buffer[k] <= 'Q')) {
+				gate.goals_uncovered++;
+			}
 			gate.map_save[j][i] = gate.buffer[k];
 			gate.map[j][i+1] = '\0';
 			gate.map_save[j][i+1] = '\0';
@@ -90,5 +92,6 @@ gate_t make_map(char const *path, gate_t gate) {
 	}
 	assert(columns <= MAX_COLUMNS);
 	assert(gate.lines <= MAX_ROWS);
+	build_passability(&gate);
 	return (gate);
 }
@@ -11,10 +11,84 @@
 #include <ncurses.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
 #include <fcntl.h>
 #include "../include/libmy.h"
 #include "../include/gate.h"
 
+// Cells written by move_location() since the last clear_dirty_cells(). A move
+// writes each cell of the piece at most twice (arrive, then vacate).
+#define MAX_DIRTY_CELLS (2 * MAX_ROWS * MAX_COLUMNS)
+static int dirty_count = 0;
+static int dirty_y[MAX_DIRTY_CELLS];
+static int dirty_x[MAX_DIRTY_CELLS];
+
+// Directions a piece cell can ever leave each cell in: walls never move, so a
+// direction is only blocked for good by a wall or the edge of the map.
+#define PASS_UP 1
+#define PASS_DOWN 2
+#define PASS_LEFT 4
+#define PASS_RIGHT 8
+static unsigned char passable[MAX_ROWS][MAX_COLUMNS];
+// Piece drawn by each map character, CELL_FREE for empty and goal cells and
+// CELL_BLOCKED for walls and anything else.
+#define CELL_FREE (-1)
+#define CELL_BLOCKED (-2)
+static signed char cell_owner[256];
+
+void build_passability(gate_t const *gate) {
+	for (int c = 0; c < 256; c++) {
+		cell_owner[c] = CELL_BLOCKED;
+	}
+	cell_owner[' '] = CELL_FREE;
+	cell_owner['G'] = CELL_FREE;
+	for (int p = 0; p < 10; p++) {
+		cell_owner['0' + p] = p;
+		cell_owner['H' + p] = p;
+	}
+
+	int length[MAX_ROWS];
+	for (int i = 0; i < gate->lines; i++) {
+		length[i] = strlen(gate->map[i]);
+	}
+	for (int i = 0; i < gate->lines; i++) {
+		for (int j = 0; j < length[i]; j++) {
+			unsigned char mask = 0;
+			if (i > 0 && j < length[i - 1] && gate->map[i - 1][j] != '#') {
+				mask |= PASS_UP;
+			}
+			if (i + 1 < gate->lines && j < length[i + 1] && gate->map[i + 1][j] != '#') {
+				mask |= PASS_DOWN;
+			}
+			if (j > 0 && gate->map[i][j - 1] != '#') {
+				mask |= PASS_LEFT;
+			}
+			if (j + 1 < length[i] && gate->map[i][j + 1] != '#') {
+				mask |= PASS_RIGHT;
+			}
+			passable[i][j] = mask;
+		}
+	}
+}
+
+static void mark_dirty(int y, int x) {
+	if (dirty_count < MAX_DIRTY_CELLS) {
+		dirty_y[dirty_count] = y;
+		dirty_x[dirty_count] = x;
+		dirty_count++;
+	}
+}
+
+int dirty_cells(int const **ys, int const **xs) {
+	*ys = dirty_y;
+	*xs = dirty_x;
+	return dirty_count;
+}
+
+void clear_dirty_cells(void) {
+	dirty_count = 0;
+}
+
 // Tries to apply any legal action
 gate_t move_location(gate_t gate, char piece, char direction){
 	//Overwrite print above...
@@ -68,7 +142,7 @@ gate_t move_location(gate_t gate, char piece, char direction){
 	for (int i = gate.piece_y[piece - '0']; i < gate.lines; i++) {
 		for (int j = 0; gate.map[i][j] != '\0'; j++) {
 			if ((gate.map[i][j] == piece || gate.map[i][j] == letterPiece) 
-				&& (! part_can_move(gate, i, j, direction))){
+				&& (! part_can_move(&gate, i, j, direction))){
 				can_move = 0;
 				break;
 			}
@@ -91,25 +165,37 @@ gate_t move_location(gate_t gate, char piece, char direction){
 	for (int i = 0; i < gate.lines; i++) {
 		for (int j = 0; gate.map[i][j] != '\0'; j++) {
 			if(gate.map_save[i][j] == piece || gate.map_save[i][j] == letterPiece) {
+				// Piece 0 arriving on a goal it did not already cover.
+				if (piece == '0' && (
+					(direction == 'u' && gate.map_save[i - 1][j] == 'G') ||
+					(direction == 'd' && gate.map_save[i + 1][j] == 'G') ||
+					(direction == 'l' && gate.map_save[i][j - 1] == 'G') ||
+					(direction == 'r' && gate.map_save[i][j + 1] == 'G'))) {
+					gate.goals_uncovered--;
+				}
 				if (direction == 'u'){
+					mark_dirty(i - 1, j);
 					if (gate.map_save[i - 1][j] == 'G' || gate.map_save[i - 1][j] == letterPiece){
 						gate.map[i - 1][j] = letterPiece;
 					} else {
 						gate.map[i - 1][j] = piece;
 					}
 				} else if (direction == 'd') {
+					mark_dirty(i + 1, j);
 					if (gate.map_save[i + 1][j] == 'G' || gate.map_save[i + 1][j] == letterPiece){
 						gate.map[i + 1][j] = letterPiece;
 					} else {
 						gate.map[i + 1][j] = piece;
 					}
 				} else if (direction == 'l') {
+					mark_dirty(i, j - 1);
 					if (gate.map_save[i][j - 1] == 'G' || gate.map_save[i][j - 1] == letterPiece){
 						gate.map[i][j - 1] = letterPiece;
 					} else {
 						gate.map[i][j - 1] = piece;
 					}
 				} else if (direction == 'r') {
+					mark_dirty(i, j + 1);
 					if (gate.map_save[i][j + 1] == 'G' || gate.map_save[i][j + 1] == letterPiece){
 						gate.map[i][j + 1] = letterPiece;
 					} else {
@@ -126,6 +212,10 @@ gate_t move_location(gate_t gate, char piece, char direction){
 					(! (direction == 'r' && (gate.map_save[i][j - 1] == piece || gate.map_save[i][j - 1] == letterPiece)))
 				   ) {
 					gate.map[i][j] = 'G';
+					mark_dirty(i, j);
+					if (piece == '0') {
+						gate.goals_uncovered++;
+					}
 				}
 				// Resolve piece on blank space:
 				// Same logic.
@@ -136,6 +226,7 @@ gate_t move_location(gate_t gate, char piece, char direction){
 					(! (direction == 'r' && (gate.map_save[i][j - 1] == piece || gate.map_save[i][j - 1] == letterPiece)))
 				   ) {
 					gate.map[i][j] = ' ';
+					mark_dirty(i, j);
 				}
 			}
 		}
@@ -159,40 +250,30 @@ gate_t move_location(gate_t gate, char piece, char direction){
 	return gate;
 }
 
-int part_can_move(gate_t gate, int y, int x, char direction) {
-	int piece = gate.map[y][x];
-	int letterPiece = gate.map[y][x];
-	if(piece >= '0' && piece <= '9') {
-		letterPiece = piece - '0' + 'H';
-	} else {
-		piece = letterPiece - 'H' + '0';
-	}
-	int can_move = 0;
+// Whether the part of a piece at (y, x) can move one cell in the direction:
+// the cell it moves into must be free or part of the same piece.
+int part_can_move(gate_t const *gate, int y, int x, char direction) {
+	int ny = y;
+	int nx = x;
+	unsigned char bit;
 	if (direction == 'u') {
-		if(gate.map[y - 1][x] == ' ' 
-			|| gate.map[y - 1][x] == 'G' || gate.map[y - 1][x] == letterPiece 
-			|| gate.map[y - 1][x] == piece) {
-			can_move = 1;
-		}
+		bit = PASS_UP;
+		ny--;
 	} else if (direction == 'd') {
-		if(gate.map[y + 1][x] == ' ' 
-			|| gate.map[y + 1][x] == 'G' || gate.map[y + 1][x] == letterPiece 
-			|| gate.map[y + 1][x] == piece) {
-			can_move = 1;
-		}
+		bit = PASS_DOWN;
+		ny++;
 	} else if (direction == 'l') {
-		if(gate.map[y][x - 1] == ' ' 
-			|| gate.map[y][x - 1] == 'G' || gate.map[y][x - 1] == letterPiece 
-			|| gate.map[y][x - 1] == piece) {
-			can_move = 1;
-		}
+		bit = PASS_LEFT;
+		nx--;
 	} else if (direction == 'r') {
-		if(gate.map[y][x + 1] == ' ' 
-			|| gate.map[y][x + 1] == 'G' || gate.map[y][x + 1] == letterPiece 
-			|| gate.map[y][x + 1] == piece) {
-			can_move = 1;
-		}
+		bit = PASS_RIGHT;
+		nx++;
+	} else {
+		return 0;
 	}
-	return can_move;
+	if (!(passable[y][x] & bit)) {
+		return 0;
+	}
+	int owner = cell_owner[(unsigned char)gate->map[ny][nx]];
+	return owner == CELL_FREE || owner == cell_owner[(unsigned char)gate->map[y][x]];
 }
-
@@ -16,6 +16,7 @@
 #include <fcntl.h>
 #include "../include/libmy.h"
 #include "../include/gate.h"
+#include "ai/hint.h"
 
 /*********
 * MACROS *
@@ -26,6 +27,22 @@
 SCREEN *mainScreen = NULL;
 WINDOW *mainWindow = NULL;
 
+// Shows the state of the last hint request below the prompts. While a search
+// is running, key reads time out so the hint appears as soon as it is ready.
+static void show_hint(int lines) {
+	char piece = 0, direction = 0;
+	hint_status_t status = hint_poll(&piece, &direction);
+	mvprintw(lines + 5, 0, "                                        ");
+	if (status == HINT_PENDING) {
+		mvprintw(lines + 5, 0, "Hint: thinking...");
+	} else if (status == HINT_READY) {
+		mvprintw(lines + 5, 0, "Hint: move piece %c in direction %c", piece, direction);
+	} else if (status == HINT_UNSOLVABLE) {
+		mvprintw(lines + 5, 0, "Hint: no solution from here");
+	}
+	timeout(status == HINT_PENDING ? 100 : -1);
+}
+
 int play(char const *path) {
 	/**
 	 * Load Map
@@ -58,48 +75,74 @@ int play(char const *path) {
 	cbreak();
 	noecho();
 	keypad(stdscr, TRUE);
+	// Block until a key arrives rather than polling.
+	timeout(-1);
 	clear();
-	
+
+	// Print board once; after that only the cells a move changes are redrawn.
+	int columns = gate.num_chars_map / gate.lines;
+	char letter[2] = "0";
+	for(int i = 1; i < columns - 1; i++){
+		mvprintw(gate.lines, i, letter);
+		letter[0] ++; //Move letter along, by editing string
+	}
+	char number[2] = "0";
+	for (int i = 0; i < gate.lines; i++){
+		if(i != 0 && i != gate.lines - 1){
+			mvprintw(i, columns, number); //-3 for new line and null byte and array zero offset
+			//mvprintw(i, gate.lines-3, number); //-3 for new line and null byte and array zero offset
+			number[0]++; //Move number along, by editing string
+		}
+		mvprintw(i, 0, gate.map[i]);
+	}
+	clear_dirty_cells();
+
 	while (1) {
-			refresh();
-			// Print board
-			int columns = gate.num_chars_map / gate.lines;
-			char letter[2] = "0";
-			for(int i = 1; i < columns - 1; i++){
-				mvprintw(gate.lines, i, letter);
-				letter[0] ++; //Move letter along, by editing string
-			}
-			char number[2] = "0";
-			for (int i = 0; i < gate.lines; i++){
-				if(i != 0 && i != gate.lines - 1){
-					mvprintw(i, columns, number); //-3 for new line and null byte and array zero offset
-					//mvprintw(i, gate.lines-3, number); //-3 for new line and null byte and array zero offset
-					number[0]++; //Move number along, by editing string
-				}
-				mvprintw(i, 0, gate.map[i]);
+			int const *dirtyY;
+			int const *dirtyX;
+			int dirtyCount = dirty_cells(&dirtyY, &dirtyX);
+			for (int i = 0; i < dirtyCount; i++) {
+				mvaddch(dirtyY[i], dirtyX[i], gate.map[dirtyY[i]][dirtyX[i]]);
 			}
+			clear_dirty_cells();
+			show_hint(gate.lines);
 			move(gate.player_y, gate.player_x);
+			refresh();
 
-			usleep(500000);
 			win_check(gate);// extra win check for gravity
 			//Check for key presses
-			gate = game_management(gate);	
+			gate = game_management(gate);
 	}
 }
 
 gate_t game_management(gate_t gate) {
 	int piece = 0 , direction = 0;
 
-	mvprintw(gate.lines + 1, 0, "Enter a piece number and a letter direction to move that piece in that direction");
+	mvprintw(gate.lines + 1, 0, "Enter a piece number and a letter direction to move that piece in that direction, or h for a hint");
 	mvprintw(gate.lines + 2, 0, "Piece:     ");
 	mvprintw(gate.lines + 3, 0, "Direction: ");
 
 	piece = getch();
+	if (piece == ERR) {
+		// Timed out while a hint is being worked out; play() shows it.
+		return (gate);
+	}
+	if (piece == 'h') {
+		hint_request(&gate);
+		return (gate);
+	}
 	mvprintw(gate.lines + 2, 0, "Piece: %c", piece);
-	direction = getch();
+	while ((direction = getch()) == ERR) {
+		show_hint(gate.lines);
+	}
 	mvprintw(gate.lines + 3, 0, "Direction: %c", direction);
 
 	gate = key_check(gate, piece, direction);
+	int const *dirtyY;
+	int const *dirtyX;
+	if (dirty_cells(&dirtyY, &dirtyX) > 0) {
+		hint_moved(piece, direction);
+	}
 	win_check(gate);
 	return (gate);
 }
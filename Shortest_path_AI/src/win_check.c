@@ -15,12 +15,8 @@
 #include "../include/gate.h"
 
 void win_check(gate_t gate) {
-	for (int i = 0; i < gate.lines; i++) {
-		for (int j = 0; gate.map_save[i][j] != '\0'; j++) {
-			if (gate.map[i][j] == 'G' || (gate.map[i][j] >= 'I' && gate.map[i][j] <= 'Q')) {
-				return ;
-			}
-		}
+	if (gate.goals_uncovered > 0) {
+		return ;
 	}
 
 	endwin();